@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+
+#include "BufferPolicies.hpp"
+
+// A coroutine suspended in a buffer's async_write() or async_read(). Waiters
+// are the awaiters themselves, which live in the suspended coroutines' frames,
+// so waiting allocates nothing. When a release may let a waiter's claim
+// succeed, the releasing thread calls the waiter's retry function, which
+// either claims the slot and resumes the coroutine or puts the waiter back on
+// its list.
+class AsyncWaiter {
+ public:
+  AsyncWaiter(AsyncWaiter const&) = delete;
+  AsyncWaiter& operator=(AsyncWaiter const&) = delete;
+
+ protected:
+  explicit AsyncWaiter(void (*retry)(AsyncWaiter&)) : m_retry{retry} {}
+  ~AsyncWaiter() = default;
+
+ private:
+  friend class AsyncWaiterList;
+
+  AsyncWaiter* m_next{};
+  void (*m_retry)(AsyncWaiter&);
+};
+
+// Lock-free stack of waiters for one kind of release, space or data. Each
+// release takes the whole stack and retries every waiter on it, so a waiter
+// whose retry fails pushes itself again.
+//
+// A waiter that fails to claim a slot pushes itself and then checks once more
+// whether a claim could succeed, while a releasing thread publishes its
+// release and then takes the stack. Every change to the head of the stack is
+// an acq_rel RMW, so either the releasing thread's exchange comes first and
+// the push synchronizes with it, making the release visible to the waiter's
+// check, or the push comes first and the exchange takes the waiter. A release
+// between the failed claim and the push is therefore never missed.
+class AsyncWaiterList {
+ public:
+  AsyncWaiterList() = default;
+  AsyncWaiterList(AsyncWaiterList const&) = delete;
+  AsyncWaiterList& operator=(AsyncWaiterList const&) = delete;
+
+  // Adds waiter. Once it is pushed, another thread may retry it at any time.
+  void push(AsyncWaiter& waiter) {
+    auto head = m_head.load(std::memory_order_relaxed);
+    do {
+      waiter.m_next = head;
+    } while (not m_head.compare_exchange_weak(head, &waiter,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_relaxed));
+  }
+
+  // Retries every waiter. Called after each release.
+  void retry_all() {
+    retry_except(m_head.exchange(nullptr, std::memory_order_acq_rel), nullptr);
+  }
+
+  // Takes every waiter off the stack and retries each one except self, which
+  // the caller retries itself. Returns whether self was on the stack; if it
+  // was not, another thread has already taken it and will retry it.
+  bool retry_all_except(AsyncWaiter& self) {
+    return retry_except(m_head.exchange(nullptr, std::memory_order_acq_rel),
+                        &self);
+  }
+
+ private:
+  std::atomic<AsyncWaiter*> m_head{};
+
+  static bool retry_except(AsyncWaiter* waiter, AsyncWaiter* self) {
+    auto found_self = false;
+    while (waiter != nullptr) {
+      // A retried waiter may be pushed again, or resumed and destroyed.
+      auto next = waiter->m_next;
+      if (waiter == self) {
+        found_self = true;
+      } else {
+        waiter->m_retry(*waiter);
+      }
+      waiter = next;
+    }
+    return found_self;
+  }
+};
+
+// Async policies, which decide whether coroutines can wait on a buffer with
+// co_await async_write() and async_read().
+//
+// NoAsyncWaiters, the default, adds nothing. AsyncWaiters keeps a waiter list
+// for space and one for data, and every release then exchanges the head of the
+// matching list, an RMW on a cache line that all releasing threads share, even
+// while no coroutine waits.
+struct NoAsyncWaiters {
+  using policy_kind = async_policy_kind;
+  auto static constexpr enabled = false;
+  struct WaiterLists {};
+};
+struct AsyncWaiters {
+  using policy_kind = async_policy_kind;
+  auto static constexpr enabled = true;
+  struct WaiterLists {
+    AsyncWaiterList space;
+    AsyncWaiterList data;
+  };
+};
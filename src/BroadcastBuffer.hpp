@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "BufferPolicies.hpp"
+
+// Circular buffer in which every subscriber sees every value, in the style of
+// the LMAX disruptor: any number of threads write, and each of up to
+// M subscribers reads all values written while it is subscribed, in order,
+// through its own cursor. Writers wait only for the slowest subscriber, and
+// subscribers can come and go while the buffer is in use. Without
+// subscribers, values are written and then lost.
+//
+// Each slot carries a sequence number that its writer sets to its ticket + 1
+// to publish it, so writers publish independently of each other, as with
+// PerSlotSequence in ThreadSafeBuffer2. Values stay in their slots after being
+// read and are overwritten by the write a full pass later, so T must be
+// default constructible and assignable. The only policy taken is a wait
+// policy; SpinThenPark backs off without parking, since a writer would have
+// to wait on every subscriber's cursor at once.
+template <typename T, int N, int M, BufferPolicy... Policies>
+class BroadcastBuffer {
+  static_assert((N & (N - 1)) == 0 and N > 0, "N must be a power of 2.");
+  static_assert(M > 0, "There must be room for at least one subscriber.");
+  static_assert((PolicyOfKind<Policies, wait_policy_kind> and ...),
+                "Only a wait policy may be given.");
+
+  using WaitPolicy =
+      select_policy_t<wait_policy_kind, SpinThenSleep, Policies...>;
+  using Ticket = std::uint64_t;
+
+  // The cursor of an unused subscriber slot, which writers ignore.
+  auto static constexpr unsubscribed = std::numeric_limits<Ticket>::max();
+
+  struct alignas(cache_line_size) Cursor {
+    // The next ticket the subscriber will read, or unsubscribed.
+    std::atomic<Ticket> next{unsubscribed};
+    std::atomic<bool> in_use{};
+  };
+
+  struct Slot {
+    // The ticket of the value in the slot + 1, once it has been written.
+    std::atomic<Ticket> sequence{};
+    T value{};
+  };
+
+ public:
+  // A subscriber's place in the buffer. Reads must come from one thread at a
+  // time. Unsubscribes when destroyed.
+  class Subscription {
+   public:
+    Subscription(Subscription&& other) noexcept
+        : m_buffer{std::exchange(other.m_buffer, nullptr)},
+          m_cursor{other.m_cursor},
+          m_next{other.m_next} {}
+
+    ~Subscription() {
+      if (m_buffer != nullptr) {
+        m_buffer->unsubscribe(*m_cursor);
+      }
+    }
+
+    // Waits for the next value and passes it to read_func as T const&.
+    template <typename ReadFunc>
+    void read_next(ReadFunc read_func) {
+      m_buffer->spinlock([this]() { return m_buffer->published(m_next); });
+      read(read_func);
+    }
+
+    // Reads the next value if it has been written, without waiting. Returns
+    // false if it has not.
+    template <typename ReadFunc>
+    bool try_read_next(ReadFunc read_func) {
+      if (not m_buffer->published(m_next)) {
+        return false;
+      }
+      read(read_func);
+      return true;
+    }
+
+   private:
+    friend class BroadcastBuffer;
+
+    Subscription(BroadcastBuffer& buffer, Cursor& cursor, Ticket next)
+        : m_buffer{&buffer}, m_cursor{&cursor}, m_next{next} {}
+
+    BroadcastBuffer* m_buffer;
+    Cursor* m_cursor;
+    // Only this subscriber advances its cursor, so it keeps its own copy.
+    Ticket m_next;
+
+    template <typename ReadFunc>
+    void read(ReadFunc& read_func) {
+      read_func(std::as_const(m_buffer->slot(m_next).value));
+      ++m_next;
+      // Hands the slot back to writers once every subscriber is past it.
+      m_cursor->next.store(m_next, std::memory_order_release);
+    }
+  };
+
+  // Starts reading with the next value to be written. Throws
+  // std::length_error if all M subscriber slots are taken.
+  Subscription subscribe() {
+    for (auto& cursor : m_cursors) {
+      auto expected = false;
+      if (cursor.in_use.compare_exchange_strong(expected, true)) {
+        // As when the disruptor adds a gating sequence: the cursor is
+        // published at the write index, then moved to the write index read
+        // after that. A writer that computed its limit before seeing the
+        // cursor did so from cursors behind that second write index, so it
+        // cannot overwrite any value from there on.
+        cursor.next.store(m_next_write_index.load());
+        auto next = m_next_write_index.load();
+        cursor.next.store(next);
+        return Subscription{*this, cursor, next};
+      }
+    }
+    throw std::length_error{"BroadcastBuffer has no free subscriber slot"};
+  }
+
+  void write_next(T t) {
+    auto write_index = m_next_write_index.load(std::memory_order_relaxed);
+    spinlock([this, &write_index]() {
+      return has_space(write_index) and
+             m_next_write_index.compare_exchange_weak(write_index,
+                                                      write_index + 1);
+    });
+    auto& slot = this->slot(write_index);
+    // Only needed without subscribers, when nothing else stops a writer from
+    // lapping one that is still writing the value a pass before.
+    if (write_index >= N) {
+      spinlock([&slot, write_index]() {
+        return slot.sequence.load(std::memory_order_acquire) ==
+               write_index - N + 1;
+      });
+    }
+    slot.value = std::move(t);
+    slot.sequence.store(write_index + 1, std::memory_order_release);
+  }
+
+ private:
+  std::array<Slot, N> m_buffer{};
+  std::array<Cursor, M> m_cursors{};
+  alignas(cache_line_size) std::atomic<Ticket> m_next_write_index{};
+  // The slowest cursor when writers last looked, so that writers only scan
+  // the cursors when they might have caught up with it. Never ahead of the
+  // slowest cursor, since cursors only move forward.
+  alignas(cache_line_size) std::atomic<Ticket> m_slowest_cursor{};
+
+  Slot& slot(Ticket index) { return m_buffer[index % N]; }
+
+  bool published(Ticket index) {
+    return slot(index).sequence.load(std::memory_order_acquire) == index + 1;
+  }
+
+  // Whether writing write_index would not overwrite a value that some
+  // subscriber has yet to read.
+  bool has_space(Ticket write_index) {
+    if (write_index < m_slowest_cursor.load(std::memory_order_acquire) + N) {
+      return true;
+    }
+    auto slowest = unsubscribed;
+    for (auto const& cursor : m_cursors) {
+      slowest = std::min(slowest, cursor.next.load());
+    }
+    if (slowest == unsubscribed) {
+      // Without subscribers, nothing needs to be kept.
+      slowest = write_index - N + 1;
+    }
+    // Released so that writers that only check the cache still see the reads
+    // of the values they overwrite.
+    m_slowest_cursor.store(slowest, std::memory_order_release);
+    return write_index < slowest + N;
+  }
+
+  void unsubscribe(Cursor& cursor) {
+    cursor.next.store(unsubscribed);
+    cursor.in_use.store(false, std::memory_order_release);
+  }
+
+  template <typename Test>
+  void spinlock(Test test_to_pass) {
+    for (int trial = 0; not test_to_pass(); ++trial) {
+      if (trial < WaitPolicy::spin_trials) {
+        WaitPolicy::spin();
+        continue;
+      }
+      trial = 0;
+      WaitPolicy::back_off();
+    }
+  }
+};
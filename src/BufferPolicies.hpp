@@ -0,0 +1,256 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+// Policies are passed to ThreadSafeBuffer2 as a list of tag types, in any
+// order. Each policy names the kind of behavior it selects through its
+// policy_kind member, and any kind that is not given takes its default.
+template <typename P>
+concept BufferPolicy = requires { typename P::policy_kind; };
+
+struct release_policy_kind {};
+struct layout_policy_kind {};
+struct memory_order_policy_kind {};
+struct wait_policy_kind {};
+struct storage_policy_kind {};
+struct ticket_policy_kind {};
+struct stats_policy_kind {};
+struct latency_policy_kind {};
+struct overflow_policy_kind {};
+struct async_policy_kind {};
+
+// Whether P is a policy of one of the given kinds.
+template <typename P, typename... Kinds>
+concept PolicyOfKind =
+    BufferPolicy<P> and (std::same_as<typename P::policy_kind, Kinds> or ...);
+
+// Passed as a buffer's capacity to choose it at run time instead.
+int constexpr dynamic_capacity = 0;
+
+// Release policies.
+//
+// InOrderRelease publishes slots through the shared m_still_writing_index and
+// m_still_reading_index counters, so each thread must wait for all threads
+// holding earlier indices to finish before it can release its own.
+//
+// PerSlotSequence tags each slot with a sequence number (Vyukov-style) that
+// records whether the slot is ready to be written or read on the current pass.
+// Each slot is published independently, so a thread that is descheduled while
+// holding an index does not stall the threads holding later indices.
+struct InOrderRelease {
+  using policy_kind = release_policy_kind;
+};
+struct PerSlotSequence {
+  using policy_kind = release_policy_kind;
+};
+
+// Layout policies.
+//
+// PackedLayout stores the index counters next to each other, which keeps the
+// buffer small but lets producers and consumers invalidate each other's cache
+// lines. PaddedIndices places each counter on its own cache line, and
+// PaddedIndicesAndSlots additionally gives each slot its own cache line, which
+// only pays off when T is much smaller than a cache line and the buffer is
+// heavily contended.
+struct PackedLayout {
+  using policy_kind = layout_policy_kind;
+  auto static constexpr pad_indices = false;
+  auto static constexpr pad_slots = false;
+};
+struct PaddedIndices {
+  using policy_kind = layout_policy_kind;
+  auto static constexpr pad_indices = true;
+  auto static constexpr pad_slots = false;
+};
+struct PaddedIndicesAndSlots {
+  using policy_kind = layout_policy_kind;
+  auto static constexpr pad_indices = true;
+  auto static constexpr pad_slots = true;
+};
+
+// Memory order policies.
+//
+// AcquireReleaseOrdering uses the weakest orderings that keep the buffer
+// correct. SequentiallyConsistentOrdering makes every atomic operation
+// seq_cst, which is useful as a reference when benchmarking or when ruling
+// out an ordering bug.
+struct AcquireReleaseOrdering {
+  using policy_kind = memory_order_policy_kind;
+  auto static constexpr relaxed = std::memory_order_relaxed;
+  auto static constexpr acquire = std::memory_order_acquire;
+  auto static constexpr release = std::memory_order_release;
+};
+struct SequentiallyConsistentOrdering {
+  using policy_kind = memory_order_policy_kind;
+  auto static constexpr relaxed = std::memory_order_seq_cst;
+  auto static constexpr acquire = std::memory_order_seq_cst;
+  auto static constexpr release = std::memory_order_seq_cst;
+};
+
+// Tells the CPU that the calling thread is spinning, which saves power and
+// frees execution resources for a sibling hyperthread.
+inline void cpu_relax() {
+#if defined(__x86_64__) or defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// Wait policies, which decide what a thread does while it waits for a slot or
+// for its turn to release one. A waiting thread retries spin_trials times,
+// calling spin() between trials, and then backs off before retrying again.
+//
+// BusySpin never gives up the CPU, for the lowest wake-up latency when every
+// thread has a core to itself. SpinThenYield yields the rest of the time
+// slice. SpinThenSleep sleeps for the shortest time the OS allows, which in
+// practice is the timer slack (about 50us on Linux). SpinThenPark blocks on
+// the index counter or slot sequence number the thread is waiting on, using
+// C++20 atomic wait/notify, so an idle thread uses no CPU and is woken as soon
+// as that counter changes. Every release then also has to notify, which is
+// cheap while nobody is parked.
+//
+// Waits with a deadline cannot park, since atomic wait has no timeout, so
+// SpinThenPark yields instead.
+struct BusySpin {
+  using policy_kind = wait_policy_kind;
+  auto static constexpr spin_trials = 64;
+  auto static constexpr parks = false;
+  static void spin() { cpu_relax(); }
+  static void back_off() { cpu_relax(); }
+};
+struct SpinThenYield {
+  using policy_kind = wait_policy_kind;
+  auto static constexpr spin_trials = 8;
+  auto static constexpr parks = false;
+  static void spin() { cpu_relax(); }
+  static void back_off() { std::this_thread::yield(); }
+};
+struct SpinThenSleep {
+  using policy_kind = wait_policy_kind;
+  auto static constexpr spin_trials = 8;
+  auto static constexpr parks = false;
+  static void spin() {}
+  static void back_off() {
+    using namespace std::chrono_literals;
+    std::this_thread::sleep_for(1ns);
+  }
+};
+struct SpinThenPark {
+  using policy_kind = wait_policy_kind;
+  auto static constexpr spin_trials = 64;
+  auto static constexpr parks = true;
+  static void spin() { cpu_relax(); }
+  static void back_off() { std::this_thread::yield(); }
+};
+
+// Waits, as directed by WaitPolicy, until done returns true for the value of
+// target, which is loaded with acquire ordering. For buffers whose waits are
+// each on a single atomic, so that SpinThenPark can park on it.
+template <typename WaitPolicy, typename U, typename Done>
+void wait_on(std::atomic<U>& target, Done done) {
+  for (int trial = 0;; ++trial) {
+    auto observed = target.load(std::memory_order_acquire);
+    if (done(observed)) {
+      return;
+    }
+    if (trial < WaitPolicy::spin_trials) {
+      WaitPolicy::spin();
+      continue;
+    }
+    trial = 0;
+    if constexpr (WaitPolicy::parks) {
+      target.wait(observed, std::memory_order_relaxed);
+    } else {
+      WaitPolicy::back_off();
+    }
+  }
+}
+
+// Wakes the threads parked by wait_on on changed.
+template <typename WaitPolicy, typename U>
+void notify_waiters(std::atomic<U>& changed) {
+  if constexpr (WaitPolicy::parks) {
+    changed.notify_all();
+  }
+}
+
+// Overflow policies, which decide what a write does when the buffer is full.
+//
+// BlockWhenFull waits for a reader to free a slot, or fails for the try and
+// timed writes. OverwriteOldest never waits for readers to catch up: a writer
+// that finds the buffer full claims the oldest value as a reader would and
+// discards it, so readers skip over it to the next value. This suits
+// telemetry, where fresh values matter more than complete ones. A writer can
+// still wait briefly for a reader or writer that is in the middle of using
+// the slot it needs. With InOrderRelease, a writer that drops a value must
+// also release it in order, so it waits for every reader holding an earlier
+// claim, however slow; combine OverwriteOldest with PerSlotSequence for
+// writers that never wait on other readers.
+struct BlockWhenFull {
+  using policy_kind = overflow_policy_kind;
+  auto static constexpr overwrite_oldest = false;
+};
+struct OverwriteOldest {
+  using policy_kind = overflow_policy_kind;
+  auto static constexpr overwrite_oldest = true;
+};
+
+// Ticket policies, which choose the width of the ever-increasing tickets that
+// index the slots. Tickets64 never wraps in practice: at 200 million
+// operations per second, it takes about 3000 years. Tickets32 wraps every 20
+// seconds at that rate, which the buffer handles since its capacity is a power
+// of 2, and halves the size of the counters and slot sequence numbers for
+// memory-tight builds.
+struct Tickets64 {
+  using policy_kind = ticket_policy_kind;
+  using ticket_type = std::uint64_t;
+};
+struct Tickets32 {
+  using policy_kind = ticket_policy_kind;
+  using ticket_type = std::uint32_t;
+};
+
+#if defined(__cpp_lib_hardware_interference_size) and defined(__GNUC__) and \
+    not defined(__clang__)
+// GCC warns that the value may differ between -mtune targets. The buffers are
+// header-only and not part of a stable ABI, so this is acceptable here.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+std::size_t constexpr cache_line_size =
+    std::hardware_destructive_interference_size;
+#pragma GCC diagnostic pop
+#else
+std::size_t constexpr cache_line_size = 64;
+#endif
+
+namespace detail {
+template <typename Kind, typename Default, BufferPolicy... Policies>
+struct select_policy {
+  using type = Default;
+};
+
+template <typename Kind, typename Default, BufferPolicy First,
+          BufferPolicy... Rest>
+struct select_policy<Kind, Default, First, Rest...>
+    : std::conditional_t<std::same_as<typename First::policy_kind, Kind>,
+                         std::type_identity<First>,
+                         select_policy<Kind, Default, Rest...>> {
+  static_assert(not std::same_as<typename First::policy_kind, Kind> or
+                    (not std::same_as<typename Rest::policy_kind, Kind> and
+                     ...),
+                "Only one policy of each kind may be given.");
+};
+}  // namespace detail
+
+// The policy of the given kind in Policies, or Default if there is none.
+template <typename Kind, typename Default, BufferPolicy... Policies>
+using select_policy_t =
+    typename detail::select_policy<Kind, Default, Policies...>::type;
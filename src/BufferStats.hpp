@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "BufferPolicies.hpp"
+
+// A number for the calling thread, for picking its shard of per-thread data.
+// Threads are numbered in the order in which they first ask, so the first n
+// threads get distinct shards out of n.
+inline std::size_t this_thread_shard() {
+  static auto next_shard = std::atomic<std::size_t>{};
+  thread_local auto const shard =
+      next_shard.fetch_add(1, std::memory_order_relaxed);
+  return shard;
+}
+
+// The events counted with ShardedStats.
+enum class BufferCounter {
+  // Values written and read, where reads include the values discarded by
+  // OverwriteOldest.
+  writes,
+  reads,
+  // Claims that lost their CAS to another thread and were retried.
+  cas_failures,
+  // Failed tests of a wait condition that were followed by WaitPolicy::spin(),
+  // by WaitPolicy::back_off() (a sleep or yield), or by parking.
+  spins,
+  back_offs,
+  parks,
+  // Attempts to claim a slot that found the buffer full or empty.
+  full_stalls,
+  empty_stalls,
+};
+
+struct BufferStatsSnapshot {
+  std::uint64_t writes{};
+  std::uint64_t reads{};
+  std::uint64_t cas_failures{};
+  std::uint64_t spins{};
+  std::uint64_t back_offs{};
+  std::uint64_t parks{};
+  std::uint64_t full_stalls{};
+  std::uint64_t empty_stalls{};
+  // The most values the buffer held at once, as seen by writers.
+  std::uint64_t max_occupancy{};
+};
+
+// Per-thread counters for ShardedStats, below.
+template <std::size_t N_shards>
+class ShardedBufferStats {
+ public:
+  void record(BufferCounter counter, std::uint64_t n = 1) {
+    // Only the owning thread normally writes to a shard, so the increment
+    // costs no more than a plain add on an uncontended cache line.
+    this_shard().counters[static_cast<std::size_t>(counter)].fetch_add(
+        n, std::memory_order_relaxed);
+  }
+
+  void record_occupancy(std::uint64_t occupancy) {
+    auto& max = this_shard().max_occupancy;
+    if (occupancy > max.load(std::memory_order_relaxed)) {
+      max.store(occupancy, std::memory_order_relaxed);
+    }
+  }
+
+  BufferStatsSnapshot snapshot() const {
+    auto totals = std::array<std::uint64_t, n_counters>{};
+    auto max_occupancy = std::uint64_t{};
+    for (auto const& shard : m_shards) {
+      for (auto i = 0u; i < n_counters; ++i) {
+        totals[i] += shard.counters[i].load(std::memory_order_relaxed);
+      }
+      max_occupancy = std::max(
+          max_occupancy, shard.max_occupancy.load(std::memory_order_relaxed));
+    }
+    auto total = [&totals](BufferCounter counter) {
+      return totals[static_cast<std::size_t>(counter)];
+    };
+    return BufferStatsSnapshot{
+        .writes = total(BufferCounter::writes),
+        .reads = total(BufferCounter::reads),
+        .cas_failures = total(BufferCounter::cas_failures),
+        .spins = total(BufferCounter::spins),
+        .back_offs = total(BufferCounter::back_offs),
+        .parks = total(BufferCounter::parks),
+        .full_stalls = total(BufferCounter::full_stalls),
+        .empty_stalls = total(BufferCounter::empty_stalls),
+        .max_occupancy = max_occupancy,
+    };
+  }
+
+ private:
+  auto static constexpr n_counters =
+      static_cast<std::size_t>(BufferCounter::empty_stalls) + 1;
+
+  struct alignas(cache_line_size) Shard {
+    std::array<std::atomic<std::uint64_t>, n_counters> counters{};
+    // Shared by the threads of a shard, which may lose each other's updates
+    // of the maximum. The result is still a value some writer saw.
+    std::atomic<std::uint64_t> max_occupancy{};
+  };
+
+  std::array<Shard, N_shards> m_shards{};
+
+  Shard& this_shard() { return m_shards[this_thread_shard() % N_shards]; }
+};
+
+// Stats policies, which decide whether a buffer counts what its threads do.
+//
+// NoStats, the default, compiles the counting out entirely. ShardedStats keeps
+// the counters in N_shards cache-line-aligned shards, and each thread counts
+// into its own shard (shared only when there are more threads than shards), so
+// counting adds no contention between threads. The shards are summed by the
+// buffer's stats_snapshot(), which may be called from any thread at any time.
+struct NoStats {
+  using policy_kind = stats_policy_kind;
+  auto static constexpr enabled = false;
+  struct Counters {
+    void record(BufferCounter, std::uint64_t = 1) {}
+    void record_occupancy(std::uint64_t) {}
+  };
+};
+template <std::size_t N_shards = 16>
+struct ShardedStats {
+  using policy_kind = stats_policy_kind;
+  auto static constexpr enabled = true;
+  using Counters = ShardedBufferStats<N_shards>;
+};
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+
+#include "BufferPolicies.hpp"
+
+// Circular buffer of N bytes holding records of any length up to
+// max_record_size, for serialized messages that would otherwise each need a
+// heap allocation. Any number of threads write and read, without locks. A
+// writer claims room for a record with claim_write(length), fills in the
+// bytes in place and commits them, and a reader is handed each record as a
+// span of bytes.
+//
+// Records are 8-byte aligned. A record never wraps around the end of the
+// buffer: when it does not fit before the end, the rest of the buffer is
+// filled with a padding record that readers skip. Records of up to half the
+// buffer therefore always fit once the buffer is empty. Each record's length
+// and state are kept in a header word outside the bytes, one for each 8-byte
+// position, so that a reader can load the header at any position atomically
+// even while a writer is filling in the bytes there.
+//
+// Counters hold byte positions that only increase. Writers claim room with a
+// compare-exchange on m_next_write_index and store the record's header, then
+// publish the header through m_still_writing_index in claim order, as with
+// InOrderRelease in ThreadSafeBuffer2; only the header is published in order,
+// so a writer that is slow to fill in its record does not hold up other
+// writers. The record itself is published by the state in its header. Readers
+// load the header at m_next_read_index and claim the record with a
+// compare-exchange moving the index past it; they then read their records
+// concurrently and hand the room back through m_still_reading_index in claim
+// order. A reader that was descheduled after loading the read index may load
+// a header that writers have since replaced, but its compare-exchange then
+// fails and it starts over, so it never reads the bytes.
+//
+// The only policy taken is a wait policy. Waits are on more than one counter,
+// so SpinThenPark yields rather than parks.
+template <int N, BufferPolicy... Policies>
+class ByteRingBuffer {
+  static_assert((N & (N - 1)) == 0 and N >= 64,
+                "N must be a power of 2 of at least 64.");
+  static_assert((PolicyOfKind<Policies, wait_policy_kind> and ...),
+                "Only a wait policy may be given.");
+
+  using WaitPolicy =
+      select_policy_t<wait_policy_kind, SpinThenSleep, Policies...>;
+  using Position = std::uint64_t;
+
+  // A record's header word holds its state in the top two bits and its
+  // length in the rest.
+  using Header = std::uint32_t;
+  enum class RecordState : Header { writing, committed, skipped };
+  auto static constexpr state_shift = 30;
+
+  static constexpr Header make_header(RecordState state, std::size_t length) {
+    return static_cast<Header>(state) << state_shift |
+           static_cast<Header>(length);
+  }
+  static constexpr RecordState state_of(Header header) {
+    return static_cast<RecordState>(header >> state_shift);
+  }
+  static constexpr std::size_t length_of(Header header) {
+    return header & ((Header{1} << state_shift) - 1u);
+  }
+
+  auto static constexpr record_alignment = std::size_t{8};
+
+  // The bytes a record of length bytes takes up. Even an empty record takes
+  // some, so that each record has its own position.
+  static constexpr std::size_t room_for(std::size_t length) {
+    return std::max(record_alignment, (length + record_alignment - 1) /
+                                          record_alignment * record_alignment);
+  }
+
+ public:
+  auto static constexpr max_record_size = std::size_t{N / 2};
+
+  // Room for one record, claimed by claim_write. If it is destroyed without
+  // being committed, readers skip the record.
+  class WriteClaim {
+   public:
+    WriteClaim(WriteClaim const&) = delete;
+    WriteClaim& operator=(WriteClaim const&) = delete;
+
+    ~WriteClaim() {
+      if (not m_committed) {
+        m_buffer.header_at(m_position)
+            .store(make_header(RecordState::skipped, m_length),
+                   std::memory_order_release);
+      }
+    }
+
+    // The bytes of the record, to be filled in before commit().
+    std::span<std::byte> bytes() const {
+      return {&m_buffer.m_bytes[m_position % N], m_length};
+    }
+
+    // Publishes the record to readers. Must be called at most once.
+    void commit() {
+      m_committed = true;
+      m_buffer.header_at(m_position)
+          .store(make_header(RecordState::committed, m_length),
+                 std::memory_order_release);
+    }
+
+   private:
+    friend class ByteRingBuffer;
+
+    WriteClaim(ByteRingBuffer& buffer, Position position, std::size_t length)
+        : m_buffer{buffer}, m_position{position}, m_length{length} {}
+
+    ByteRingBuffer& m_buffer;
+    Position m_position;
+    std::size_t m_length;
+    bool m_committed = false;
+  };
+
+  ByteRingBuffer() = default;
+  ByteRingBuffer(ByteRingBuffer const&) = delete;
+  ByteRingBuffer& operator=(ByteRingBuffer const&) = delete;
+
+  // Waits for room for a record of length bytes and claims it. Throws
+  // std::length_error if length is over max_record_size.
+  WriteClaim claim_write(std::size_t length) {
+    check_length(length);
+    auto write_index = m_next_write_index.load(std::memory_order_relaxed);
+    spinlock([this, &write_index, length]() {
+      return try_acquire_room(write_index, length);
+    });
+    return WriteClaim{*this, publish_headers(write_index, length), length};
+  }
+
+  void write_next(std::span<std::byte const> record) {
+    auto claim = claim_write(record.size());
+    std::ranges::copy(record, claim.bytes().begin());
+    claim.commit();
+  }
+
+  // Writes record if there is room for it, without waiting. Returns false if
+  // there is not.
+  bool try_write_next(std::span<std::byte const> record) {
+    check_length(record.size());
+    auto write_index = m_next_write_index.load(std::memory_order_relaxed);
+    while (not try_acquire_room(write_index, record.size())) {
+      if (not has_room(write_index, record.size())) {
+        return false;
+      }
+    }
+    auto claim = WriteClaim{
+        *this, publish_headers(write_index, record.size()), record.size()};
+    std::ranges::copy(record, claim.bytes().begin());
+    claim.commit();
+    return true;
+  }
+
+  // Waits for the next record and passes it to read_func as a
+  // std::span<std::byte const>, which is valid until read_func returns.
+  template <typename ReadFunc>
+  void read_next(ReadFunc read_func) {
+    spinlock([this, &read_func]() { return try_read(read_func); });
+  }
+
+  // Reads the next record if it has been committed, without waiting for it.
+  // Returns false if it has not, even if later records have been.
+  template <typename ReadFunc>
+  bool try_read_next(ReadFunc read_func) {
+    return try_read(read_func);
+  }
+
+ private:
+  alignas(cache_line_size) std::array<std::byte, N> m_bytes{};
+  alignas(cache_line_size)
+      std::array<std::atomic<Header>, N / record_alignment> m_headers{};
+  alignas(cache_line_size) std::atomic<Position> m_next_write_index{};
+  alignas(cache_line_size) std::atomic<Position> m_still_writing_index{};
+  alignas(cache_line_size) std::atomic<Position> m_next_read_index{};
+  alignas(cache_line_size) std::atomic<Position> m_still_reading_index{};
+
+  static void check_length(std::size_t length) {
+    if (length > max_record_size) {
+      throw std::length_error{"ByteRingBuffer record is too long"};
+    }
+  }
+
+  std::atomic<Header>& header_at(Position position) {
+    return m_headers[position % N / record_alignment];
+  }
+
+  // The padding needed before a record of length bytes at position, so that
+  // the record does not wrap around the end of the buffer.
+  static std::size_t padding_before(Position position, std::size_t length) {
+    auto const offset = position % N;
+    return offset + room_for(length) > N ? N - offset : 0;
+  }
+
+  // Whether a record of length bytes fits at write_index. Nothing orders the
+  // relaxed load of write_index against the load of m_still_reading_index, so
+  // the two are compared through their signed difference: a stale counter
+  // only makes the buffer look full, and a stale write_index passes, to be
+  // updated by the failing compare-exchange.
+  bool has_room(Position write_index, std::size_t length) {
+    auto const needed = padding_before(write_index, length) + room_for(length);
+    return static_cast<std::int64_t>(
+               write_index + needed -
+               m_still_reading_index.load(std::memory_order_acquire)) <= N;
+  }
+
+  // Claims room at write_index for a record of length bytes and any padding
+  // before it. On failure, write_index is updated to the current write index.
+  bool try_acquire_room(Position& write_index, std::size_t length) {
+    if (not has_room(write_index, length)) {
+      write_index = m_next_write_index.load(std::memory_order_relaxed);
+      return false;
+    }
+    auto const needed = padding_before(write_index, length) + room_for(length);
+    return m_next_write_index.compare_exchange_weak(
+        write_index, write_index + needed, std::memory_order_relaxed);
+  }
+
+  // Stores the headers of the record claimed at write_index and of any
+  // padding before it, and publishes them in claim order. Returns the
+  // record's position.
+  Position publish_headers(Position write_index, std::size_t length) {
+    auto const padding = padding_before(write_index, length);
+    if (padding != 0) {
+      // The padding's room is its length, as it is a multiple of 8.
+      header_at(write_index)
+          .store(make_header(RecordState::skipped, padding),
+                 std::memory_order_relaxed);
+    }
+    auto const position = write_index + padding;
+    header_at(position).store(make_header(RecordState::writing, length),
+                              std::memory_order_relaxed);
+    // Acquire, so that the headers of earlier writers are published along
+    // with this one.
+    spinlock([this, write_index]() {
+      return m_still_writing_index.load(std::memory_order_acquire) ==
+             write_index;
+    });
+    m_still_writing_index.store(position + room_for(length),
+                                std::memory_order_release);
+    return position;
+  }
+
+  template <typename ReadFunc>
+  bool try_read(ReadFunc& read_func) {
+    auto read_index = m_next_read_index.load(std::memory_order_relaxed);
+    while (true) {
+      // Signed, as in has_room, so that a stale counter makes the buffer
+      // look empty rather than pass for a position not yet written on this
+      // pass, whose header is still the committed one of the last pass.
+      if (static_cast<std::int64_t>(
+              m_still_writing_index.load(std::memory_order_acquire) -
+              read_index) <= 0) {
+        return false;
+      }
+      // Acquire, so that a committed record's bytes are visible. If another
+      // reader has claimed the record since read_index was loaded, this may
+      // be the header of a later record, but the claim below then fails.
+      auto const header = header_at(read_index).load(std::memory_order_acquire);
+      auto const state = state_of(header);
+      if (state == RecordState::writing) {
+        auto const current = m_next_read_index.load(std::memory_order_relaxed);
+        if (current == read_index) {
+          return false;
+        }
+        read_index = current;
+        continue;
+      }
+      auto const room = room_for(length_of(header));
+      if (not m_next_read_index.compare_exchange_weak(
+              read_index, read_index + room, std::memory_order_relaxed)) {
+        continue;
+      }
+
+      // Padding, and records whose claim was dropped, are skipped.
+      if (state == RecordState::committed) {
+        read_func(std::span<std::byte const>{&m_bytes[read_index % N],
+                                             length_of(header)});
+      }
+      release_room(read_index, room);
+      if (state == RecordState::committed) {
+        return true;
+      }
+      read_index = m_next_read_index.load(std::memory_order_relaxed);
+    }
+  }
+
+  // Hands the room of the record at read_index back to writers, in claim
+  // order, and with the reads of earlier readers.
+  void release_room(Position read_index, std::size_t room) {
+    spinlock([this, read_index]() {
+      return m_still_reading_index.load(std::memory_order_acquire) ==
+             read_index;
+    });
+    m_still_reading_index.store(read_index + room, std::memory_order_release);
+  }
+
+  template <typename Test>
+  void spinlock(Test test_to_pass) {
+    for (int trial = 0; not test_to_pass(); ++trial) {
+      if (trial < WaitPolicy::spin_trials) {
+        WaitPolicy::spin();
+        continue;
+      }
+      trial = 0;
+      WaitPolicy::back_off();
+    }
+  }
+};
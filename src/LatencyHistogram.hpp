@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+#include "BufferPolicies.hpp"
+#include "BufferStats.hpp"
+
+// A histogram of durations in nanoseconds with log-linear buckets, as in HDR
+// histograms: each power-of-2 range of durations is split into 16 equal
+// buckets, so any recorded duration is known to within 1/16 (6.25%) while the
+// whole range of 64-bit durations takes under 1000 buckets.
+class LatencyHistogram {
+ public:
+  auto static constexpr sub_bucket_bits = 4;
+  auto static constexpr n_sub_buckets = std::size_t{1} << sub_bucket_bits;
+  auto static constexpr n_buckets = (64 - sub_bucket_bits + 1) * n_sub_buckets;
+
+  static constexpr std::size_t bucket_of(std::uint64_t ns) {
+    if (ns < n_sub_buckets) {
+      return ns;
+    }
+    auto exponent = std::bit_width(ns) - 1;
+    auto sub_bucket =
+        (ns >> (exponent - sub_bucket_bits)) & (n_sub_buckets - 1);
+    return (exponent - sub_bucket_bits + 1) * n_sub_buckets + sub_bucket;
+  }
+
+  // The smallest and largest durations that fall into bucket.
+  static constexpr std::uint64_t lowest_in(std::size_t bucket) {
+    if (bucket < n_sub_buckets) {
+      return bucket;
+    }
+    auto exponent = bucket / n_sub_buckets + sub_bucket_bits - 1;
+    auto sub_bucket = bucket % n_sub_buckets;
+    return (n_sub_buckets + sub_bucket) << (exponent - sub_bucket_bits);
+  }
+  static constexpr std::uint64_t highest_in(std::size_t bucket) {
+    return bucket + 1 == n_buckets ? std::numeric_limits<std::uint64_t>::max()
+                                   : lowest_in(bucket + 1) - 1;
+  }
+
+  void record(std::uint64_t ns, std::uint64_t n = 1) {
+    m_counts[bucket_of(ns)] += n;
+    m_count += n;
+  }
+
+  void add_to_bucket(std::size_t bucket, std::uint64_t n) {
+    m_counts[bucket] += n;
+    m_count += n;
+  }
+
+  LatencyHistogram& operator+=(LatencyHistogram const& other) {
+    for (auto i = 0u; i < n_buckets; ++i) {
+      m_counts[i] += other.m_counts[i];
+    }
+    m_count += other.m_count;
+    return *this;
+  }
+
+  std::uint64_t count() const { return m_count; }
+  std::uint64_t count_in(std::size_t bucket) const { return m_counts[bucket]; }
+
+  // The duration that percent percent of the recorded durations are at most,
+  // rounded up to the end of its bucket. 0 if nothing was recorded.
+  std::uint64_t percentile(double percent) const {
+    if (m_count == 0u) {
+      return 0u;
+    }
+    auto rank = std::max<std::uint64_t>(
+        1u, static_cast<std::uint64_t>(percent / 100.0 * m_count + 0.5));
+    auto seen = std::uint64_t{};
+    for (auto i = 0u; i < n_buckets; ++i) {
+      seen += m_counts[i];
+      if (seen >= rank) {
+        return highest_in(i);
+      }
+    }
+    return highest_in(n_buckets - 1);
+  }
+
+ private:
+  std::array<std::uint64_t, n_buckets> m_counts{};
+  std::uint64_t m_count{};
+};
+
+// One LatencyHistogram per thread shard, for LatencyTracing, below. Recording
+// only touches the calling thread's shard.
+template <std::size_t N_shards>
+class ShardedLatencyHistograms {
+ public:
+  void record(std::uint64_t ns) {
+    (*m_shards)[this_thread_shard() % N_shards]
+        .counts[LatencyHistogram::bucket_of(ns)]
+        .fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // The histograms of all shards, merged.
+  LatencyHistogram merged() const {
+    auto histogram = LatencyHistogram{};
+    for (auto const& shard : *m_shards) {
+      for (auto i = 0u; i < LatencyHistogram::n_buckets; ++i) {
+        histogram.add_to_bucket(
+            i, shard.counts[i].load(std::memory_order_relaxed));
+      }
+    }
+    return histogram;
+  }
+
+ private:
+  struct alignas(cache_line_size) Shard {
+    std::array<std::atomic<std::uint64_t>, LatencyHistogram::n_buckets>
+        counts{};
+  };
+
+  // On the heap, as it is too large to sit inline in every traced buffer.
+  std::unique_ptr<std::array<Shard, N_shards>> m_shards =
+      std::make_unique<std::array<Shard, N_shards>>();
+};
+
+#if defined(__x86_64__) or defined(__i386__)
+// A clock that reads the CPU's time-stamp counter, which takes a few
+// nanoseconds where steady_clock::now() takes a few tens. The counter's rate is
+// measured against steady_clock once per process, by calibrate() or else on
+// first use, which takes 10ms. Only suitable on CPUs with an invariant TSC,
+// which runs at a constant rate on all cores, as on any x86 CPU from the last
+// 15 years.
+struct TscClock {
+  using duration = std::chrono::nanoseconds;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::time_point<TscClock>;
+  auto static constexpr is_steady = true;
+
+  static time_point now() {
+    return time_point{duration{
+        static_cast<rep>(static_cast<double>(__builtin_ia32_rdtsc()) *
+                         ns_per_tick())}};
+  }
+
+  // Measures the counter's rate now if it has not been measured yet.
+  // LatencyTracing calls this when a buffer is constructed, so that the first
+  // traced write does not pay for it.
+  static void calibrate() { ns_per_tick(); }
+
+ private:
+  static double ns_per_tick() {
+    auto static const ns_per_tick = measure_ns_per_tick();
+    return ns_per_tick;
+  }
+
+  static double measure_ns_per_tick() {
+    using namespace std::chrono_literals;
+    auto start = std::chrono::steady_clock::now();
+    auto start_ticks = __builtin_ia32_rdtsc();
+    while (std::chrono::steady_clock::now() - start < 10ms) {
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    auto ticks = __builtin_ia32_rdtsc() - start_ticks;
+    return std::chrono::duration<double, std::nano>{elapsed}.count() /
+           static_cast<double>(ticks);
+  }
+};
+#endif
+
+// Latency policies, which decide whether a buffer measures how long values
+// wait in it.
+//
+// NoLatencyTracing, the default, adds nothing. LatencyTracing stamps each slot
+// with the time on Clock when it is published, and on each read records the
+// time since then in the reading thread's histogram. The histograms of all
+// threads are merged by the buffer's latency_histogram(). Every write and read
+// then reads the clock once per claim, and each slot grows by the 8-byte
+// stamp. The histograms take N_shards * 7.6KB (about 122KB with the default
+// 16 shards), allocated on the heap along with the buffer. A Clock with a
+// calibrate() function, such as TscClock, is calibrated when the buffer is
+// constructed.
+struct NoLatencyTracing {
+  using policy_kind = latency_policy_kind;
+  auto static constexpr enabled = false;
+  struct Histograms {
+    void record(std::uint64_t) {}
+  };
+};
+template <typename Clock = std::chrono::steady_clock,
+          std::size_t N_shards = 16>
+struct LatencyTracing {
+  using policy_kind = latency_policy_kind;
+  auto static constexpr enabled = true;
+  using Histograms = ShardedLatencyHistograms<N_shards>;
+
+  static void calibrate_clock() {
+    if constexpr (requires { Clock::calibrate(); }) {
+      Clock::calibrate();
+    }
+  }
+
+  static std::uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               Clock::now().time_since_epoch())
+        .count();
+  }
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+#include "BufferPolicies.hpp"
+
+// Circular buffer whose values pass through N_stages processing stages in
+// place, such as decode, enrich and publish, instead of being copied through a
+// chain of buffers. Any number of threads write, and any number of threads
+// work on each stage. Each value is written once, handed as T& to one thread
+// of each stage in turn, and its slot is reused once the last stage is done
+// with it. Each stage sees the values in the order they were written, though
+// threads of the same stage may finish them out of order.
+//
+// Each slot carries a sequence number, as with PerSlotSequence in
+// ThreadSafeBuffer2, that records which ticket the slot holds and which stage
+// it is waiting for: ticket * (N_stages + 1) when it is free for that ticket's
+// writer, plus 1 + k once the value is ready for stage k. A stage therefore
+// waits on exactly the values it needs rather than on a shared cursor, and a
+// thread that is descheduled while holding a value only holds back the threads
+// waiting on that slot. Since each wait is on a single slot, SpinThenPark
+// parks on it.
+//
+// Values stay in their slots between passes, so T must be default
+// constructible and assignable. The only policy taken is a wait policy.
+template <typename T, int N, int N_stages, BufferPolicy... Policies>
+class PipelineBuffer {
+  static_assert((N & (N - 1)) == 0 and N > 0, "N must be a power of 2.");
+  static_assert(N_stages > 0, "There must be at least one stage.");
+  static_assert((PolicyOfKind<Policies, wait_policy_kind> and ...),
+                "Only a wait policy may be given.");
+
+  using WaitPolicy =
+      select_policy_t<wait_policy_kind, SpinThenSleep, Policies...>;
+  using Ticket = std::uint64_t;
+
+  // The number of states a slot goes through for each ticket.
+  auto static constexpr n_phases = Ticket{N_stages} + 1;
+
+ public:
+  PipelineBuffer() {
+    for (auto i = 0; i < N; ++i) {
+      m_buffer[i].sequence.store(i * n_phases, std::memory_order_relaxed);
+    }
+  }
+
+  PipelineBuffer(PipelineBuffer const&) = delete;
+  PipelineBuffer& operator=(PipelineBuffer const&) = delete;
+
+  void write_next(T t) {
+    auto write_index = claim(0);
+    auto& slot = this->slot(write_index);
+    wait_for(slot.sequence, write_index * n_phases);
+    slot.value = std::move(t);
+    publish(slot.sequence, write_index * n_phases + 1);
+  }
+
+  // Waits for the next value that stage Stage has not yet taken to be done by
+  // the stage before, and passes it to process_func as T&.
+  template <int Stage, typename ProcessFunc>
+  void process_next(ProcessFunc process_func) {
+    static_assert(Stage >= 0 and Stage < N_stages, "No such stage.");
+    auto index = claim(Stage + 1);
+    auto& slot = this->slot(index);
+    wait_for(slot.sequence, index * n_phases + 1 + Stage);
+    process_func(slot.value);
+    if constexpr (Stage + 1 < N_stages) {
+      publish(slot.sequence, index * n_phases + 2 + Stage);
+    } else {
+      publish(slot.sequence, (index + N) * n_phases);
+    }
+  }
+
+ private:
+  struct Slot {
+    std::atomic<Ticket> sequence{};
+    T value{};
+  };
+
+  struct alignas(cache_line_size) Counter {
+    std::atomic<Ticket> next{};
+  };
+
+  std::array<Slot, N> m_buffer{};
+  // The next ticket to be claimed by the writers, then by each stage.
+  std::array<Counter, N_stages + 1> m_next_indices{};
+
+  Slot& slot(Ticket index) { return m_buffer[index % N]; }
+
+  Ticket claim(int counter) {
+    return m_next_indices[counter].next.fetch_add(1,
+                                                  std::memory_order_relaxed);
+  }
+
+  void wait_for(std::atomic<Ticket>& sequence, Ticket expected) {
+    wait_on<WaitPolicy>(sequence, [expected](Ticket observed) {
+      return observed == expected;
+    });
+  }
+
+  void publish(std::atomic<Ticket>& sequence, Ticket value) {
+    sequence.store(value, std::memory_order_release);
+    notify_waiters<WaitPolicy>(sequence);
+  }
+};
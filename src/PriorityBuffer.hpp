@@ -0,0 +1,190 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <utility>
+
+#include "BufferPolicies.hpp"
+#include "ThreadSafeBuffer2.hpp"
+
+// Lane orders, which decide which lane of a PriorityBuffer a reader takes the
+// next value from when several lanes have values.
+//
+// StrictPriority always takes from the lowest-numbered lane that has values,
+// so lane 0 overtakes everything else and the other lanes can starve.
+// WeightedRoundRobin<Weights...> gives lane i Weights[i] out of every sum of
+// Weights reads, spread evenly over the cycle (smooth weighted round-robin, as
+// in nginx), and hands a read whose lane is empty to the next lane that is not,
+// so no read waits while any lane has values. The cycle position is shared by
+// all readers.
+struct StrictPriority {};
+
+template <int... Weights>
+struct WeightedRoundRobin {
+  static_assert(((Weights > 0) and ...), "Weights must be positive.");
+};
+
+// K ThreadSafeBuffer2 lanes of capacity N each, with lane 0 the most urgent,
+// so that urgent values such as control messages can overtake bulk data.
+// Writers pick a lane, and readers read from the lanes in LaneOrder. Values in
+// the same lane are read in the order they were written.
+//
+// A bitmask records which lanes may have values, so that readers only try
+// lanes that do. Writers set a lane's bit after each write, and a reader that
+// finds the lane empty clears it and then checks the lane again, so that a
+// write that lands between the failed read and the clearing is not missed.
+// When every bit is clear, readers with SpinThenPark park on the bitmask.
+// The lanes take Policies as given.
+template <typename T, int N, int K, typename LaneOrder = StrictPriority,
+          BufferPolicy... Policies>
+class PriorityBuffer {
+  static_assert(K > 0 and K <= 64, "There must be between 1 and 64 lanes.");
+  static_assert(N != dynamic_capacity,
+                "The lanes are created together, with capacity N each.");
+
+  using Lane = ThreadSafeBuffer2<T, N, Policies...>;
+  using WaitPolicy =
+      select_policy_t<wait_policy_kind, SpinThenSleep, Policies...>;
+  using LaneMask = std::uint64_t;
+
+  template <typename Order>
+  struct Schedule {
+    static_assert(sizeof(Order) == 0,
+                  "LaneOrder must be StrictPriority or WeightedRoundRobin.");
+  };
+  template <typename Order>
+    requires std::same_as<Order, StrictPriority>
+  struct Schedule<Order> {
+    auto static constexpr cycle_length = 0;
+  };
+  template <int... Weights>
+  struct Schedule<WeightedRoundRobin<Weights...>> {
+    static_assert(sizeof...(Weights) == K, "Give one weight per lane.");
+    auto static constexpr cycle_length = (Weights + ...);
+
+    // The lane to try first for each read in the cycle.
+    static constexpr std::array<int, cycle_length> lanes() {
+      auto const weights = std::array{Weights...};
+      auto current = std::array<int, K>{};
+      auto lanes = std::array<int, cycle_length>{};
+      for (auto& lane : lanes) {
+        lane = 0;
+        for (auto i = 0; i < K; ++i) {
+          current[i] += weights[i];
+          if (current[i] > current[lane]) {
+            lane = i;
+          }
+        }
+        current[lane] -= cycle_length;
+      }
+      return lanes;
+    }
+  };
+
+  auto static constexpr weighted = Schedule<LaneOrder>::cycle_length > 0;
+
+ public:
+  auto static constexpr n_lanes = K;
+
+  PriorityBuffer() = default;
+  PriorityBuffer(PriorityBuffer const&) = delete;
+  PriorityBuffer& operator=(PriorityBuffer const&) = delete;
+
+  void write_next(int lane, T t) {
+    m_lanes[lane].write_next(std::move(t));
+    mark_non_empty(lane);
+  }
+
+  // Writes t if lane has a free slot, without waiting for one. Returns false,
+  // leaving t untouched, if the lane is full.
+  template <typename U = T>
+    requires std::constructible_from<T, U&&>
+  bool try_write_next(int lane, U&& t) {
+    if (not m_lanes[lane].try_write_next(std::forward<U>(t))) {
+      return false;
+    }
+    mark_non_empty(lane);
+    return true;
+  }
+
+  template <typename ReadFunc>
+  void read_next(ReadFunc read_func) {
+    for (int trial = 0; not try_read_next(read_func); ++trial) {
+      if (trial < WaitPolicy::spin_trials) {
+        WaitPolicy::spin();
+        continue;
+      }
+      trial = 0;
+      if constexpr (WaitPolicy::parks) {
+        m_non_empty.wait(0, std::memory_order_acquire);
+      } else {
+        WaitPolicy::back_off();
+      }
+    }
+  }
+
+  // Reads a value from the lane LaneOrder picks among those with values.
+  // Returns false if every lane was empty when tried.
+  template <typename ReadFunc>
+  bool try_read_next(ReadFunc read_func) {
+    auto first = 0;
+    if constexpr (weighted) {
+      auto static constexpr schedule = Schedule<LaneOrder>::lanes();
+      first = schedule[m_turn.fetch_add(1, std::memory_order_relaxed) %
+                       schedule.size()];
+    }
+    // Each lane is tried at most once, so that a lane whose only value is
+    // still being written or read does not keep the reader here.
+    for (auto mask = m_non_empty.load(std::memory_order_acquire); mask != 0;) {
+      auto lane = next_lane(mask, first);
+      if (m_lanes[lane].try_read_next(read_func)) {
+        return true;
+      }
+      mark_empty(lane);
+      mask &= ~bit(lane);
+    }
+    return false;
+  }
+
+  // The approximate number of values in lane.
+  std::size_t size_approx(int lane) const {
+    return m_lanes[lane].size_approx();
+  }
+
+ private:
+  std::array<Lane, K> m_lanes{};
+  alignas(cache_line_size) std::atomic<LaneMask> m_non_empty{};
+  // The position in the weighted round-robin cycle.
+  alignas(cache_line_size) std::atomic<std::uint64_t> m_turn{};
+
+  static LaneMask bit(int lane) { return LaneMask{1} << lane; }
+
+  // The first lane in mask at or after first, wrapping around to lane 0.
+  static int next_lane(LaneMask mask, int first) {
+    auto const at_or_after = mask & ~(bit(first) - 1);
+    return std::countr_zero(at_or_after != 0 ? at_or_after : mask);
+  }
+
+  void mark_non_empty(int lane) {
+    // Only the write that sets the first bit can have a reader parked.
+    auto const previous =
+        m_non_empty.fetch_or(bit(lane), std::memory_order_acq_rel);
+    if constexpr (WaitPolicy::parks) {
+      if (previous == 0) {
+        m_non_empty.notify_all();
+      }
+    }
+  }
+
+  void mark_empty(int lane) {
+    m_non_empty.fetch_and(~bit(lane), std::memory_order_acq_rel);
+    // A write may have landed after the failed read but before the bit was
+    // cleared, in which case its bit was lost.
+    if (not m_lanes[lane].empty()) {
+      mark_non_empty(lane);
+    }
+  }
+};
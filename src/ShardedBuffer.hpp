@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <thread>
+#include <utility>
+
+#include "BufferPolicies.hpp"
+#include "BufferStats.hpp"
+#include "StoragePolicies.hpp"
+#include "ThreadSafeBuffer2.hpp"
+
+// A front-end over several ThreadSafeBuffer2 shards of capacity N each, so
+// that many writers do not all contend on one buffer's write index. Each
+// thread has a home shard, chosen by this_thread_shard(). Writers only write
+// to their home shard, so the values of one writer are still read in the order
+// they were written. Readers read from their home shard while it has values
+// and otherwise steal from the other shards in turn.
+//
+// Only the order of each writer's values is kept; values from different
+// writers can be read in any order, even when they were written one after the
+// other. The shards take Policies as given. A reader waiting for a value polls
+// every shard, so with SpinThenPark it yields rather than parks.
+template <typename T, int N, BufferPolicy... Policies>
+class ShardedBuffer {
+  static_assert(N != dynamic_capacity,
+                "The shards are created together, with capacity N each.");
+
+  using Shard = ThreadSafeBuffer2<T, N, Policies...>;
+  using WaitPolicy =
+      select_policy_t<wait_policy_kind, SpinThenSleep, Policies...>;
+
+ public:
+  // One shard per hardware thread by default.
+  explicit ShardedBuffer(
+      std::size_t n_shards = std::max(1u, std::thread::hardware_concurrency()))
+      : m_shards{n_shards} {}
+
+  ShardedBuffer(ShardedBuffer const&) = delete;
+  ShardedBuffer& operator=(ShardedBuffer const&) = delete;
+
+  std::size_t n_shards() const { return m_shards.size(); }
+
+  // The shard the calling thread writes to, and reads from first.
+  std::size_t home_shard_index() const {
+    return this_thread_shard() % m_shards.size();
+  }
+
+  void write_next(T t) { home_shard().write_next(std::move(t)); }
+
+  // Writes to the given shard rather than the home shard, for writers that are
+  // placed by the caller, such as one per NUMA node. The values written to one
+  // shard by one thread are still read in the order they were written.
+  void write_next_to(std::size_t shard, T t) {
+    m_shards[shard % m_shards.size()].write_next(std::move(t));
+  }
+
+  // Fails if the home shard is full, even if other shards have space.
+  template <typename U = T>
+    requires std::constructible_from<T, U&&>
+  bool try_write_next(U&& t) {
+    return home_shard().try_write_next(std::forward<U>(t));
+  }
+
+  template <typename ReadFunc>
+  void read_next(ReadFunc read_func) {
+    for (int trial = 0; not try_read_next(read_func); ++trial) {
+      if (trial < WaitPolicy::spin_trials) {
+        WaitPolicy::spin();
+        continue;
+      }
+      trial = 0;
+      WaitPolicy::back_off();
+    }
+  }
+
+  // Reads a value from the home shard, or else from the first other shard
+  // that has one. Returns false if every shard was empty when tried.
+  template <typename ReadFunc>
+  bool try_read_next(ReadFunc read_func) {
+    auto const home = home_shard_index();
+    for (auto i = std::size_t{}; i < m_shards.size(); ++i) {
+      auto& shard = m_shards[(home + i) % m_shards.size()];
+      // Checked first, so that readers looking for work do not contend on
+      // the read index of shards with nothing to steal.
+      if (not shard.empty() and shard.try_read_next(read_func)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The approximate number of values in all shards.
+  std::size_t size_approx() const {
+    auto size = std::size_t{};
+    for (auto const& shard : m_shards) {
+      size += shard.size_approx();
+    }
+    return size;
+  }
+
+ private:
+  HeapArray<Shard, AlignedHeapStorage> m_shards;
+
+  Shard& home_shard() { return m_shards[home_shard_index()]; }
+};
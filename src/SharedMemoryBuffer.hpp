@@ -0,0 +1,308 @@
+#pragma once
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include "BufferPolicies.hpp"
+
+// Circular buffer for threads in different processes, kept in a POSIX shared
+// memory object. One process creates the buffer under a name, and others open
+// it by that name and map the same memory.
+//
+// The mapping holds a header and the slots, with no pointers, so each process
+// may map it at a different address. Writers and readers claim slots through
+// counters in the header and publish them through a per-slot sequence number,
+// as with PerSlotSequence in ThreadSafeBuffer2; the counters and sequence
+// numbers are 32-bit, as with Tickets32, so that a waiting thread can sleep on
+// them with a futex. A waiting thread spins first, then counts itself in the
+// header's waiter count and sleeps in FUTEX_WAIT, and threads only make the
+// FUTEX_WAKE system call while that count is not zero.
+//
+// The header starts with a magic number and layout version, followed by the
+// capacity and value size, which open() checks against its own template
+// arguments. The magic number is stored last by create(), so open() fails
+// rather than use a buffer that is still being set up.
+//
+// Values are copied between processes byte for byte, so T must be trivially
+// copyable. A process that dies while holding a slot leaves that slot, and
+// eventually the buffer, stuck.
+template <typename T, int N>
+class SharedMemoryBuffer {
+  static_assert((N & (N - 1)) == 0 and N > 0, "N must be a power of 2.");
+  static_assert(std::is_trivially_copyable_v<T>,
+                "T is copied between processes byte for byte.");
+  static_assert(std::atomic<std::uint32_t>::is_always_lock_free and
+                    std::atomic<std::uint64_t>::is_always_lock_free,
+                "Atomics in shared memory must be lock-free to work across "
+                "processes.");
+
+  using Ticket = std::uint32_t;
+
+ public:
+  // "TSB2SHM1" in ASCII.
+  auto static constexpr magic = std::uint64_t{0x5453'4232'5348'4d31};
+  auto static constexpr layout_version = std::uint32_t{1};
+
+  // Creates the shared memory object name, which must not exist yet, and
+  // sets up an empty buffer in it. Throws std::system_error on failure.
+  static SharedMemoryBuffer create(std::string const& name) {
+    auto fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1) {
+      throw_errno("shm_open");
+    }
+    if (ftruncate(fd, sizeof(Region)) == -1) {
+      auto const error = errno;
+      close(fd);
+      shm_unlink(name.c_str());
+      throw std::system_error{error, std::generic_category(), "ftruncate"};
+    }
+    auto region = static_cast<Region*>(nullptr);
+    try {
+      region = map(fd);
+    } catch (...) {
+      shm_unlink(name.c_str());
+      throw;
+    }
+    auto buffer = SharedMemoryBuffer{region};
+    auto& header = buffer.m_region->header;
+    header.layout_version = layout_version;
+    header.capacity = N;
+    header.value_size = sizeof(T);
+    header.value_alignment = alignof(T);
+    for (auto i = Ticket{}; i < N; ++i) {
+      buffer.slot(i).sequence.store(i, std::memory_order_relaxed);
+    }
+    header.magic.store(magic, std::memory_order_release);
+    return buffer;
+  }
+
+  // Maps the buffer that create() set up under name. Throws
+  // std::system_error if it cannot be mapped, and std::runtime_error if it
+  // is not a buffer of this type or is not set up yet.
+  static SharedMemoryBuffer open(std::string const& name) {
+    auto fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd == -1) {
+      throw_errno("shm_open");
+    }
+    struct stat status {};
+    if (fstat(fd, &status) == -1) {
+      auto const error = errno;
+      close(fd);
+      throw std::system_error{error, std::generic_category(), "fstat"};
+    }
+    if (static_cast<std::size_t>(status.st_size) != sizeof(Region)) {
+      close(fd);
+      throw std::runtime_error{"shared memory object has the wrong size"};
+    }
+    auto buffer = SharedMemoryBuffer{map(fd)};
+    auto const& header = buffer.m_region->header;
+    if (header.magic.load(std::memory_order_acquire) != magic) {
+      throw std::runtime_error{"shared memory buffer is not set up"};
+    }
+    if (header.layout_version != layout_version or header.capacity != N or
+        header.value_size != sizeof(T) or
+        header.value_alignment != alignof(T)) {
+      throw std::runtime_error{
+          "shared memory buffer has a different layout or type"};
+    }
+    return buffer;
+  }
+
+  // Removes name, so that it can no longer be opened. Mappings that already
+  // exist stay valid.
+  static void remove(std::string const& name) { shm_unlink(name.c_str()); }
+
+  SharedMemoryBuffer(SharedMemoryBuffer&& other) noexcept
+      : m_region{std::exchange(other.m_region, nullptr)} {}
+  SharedMemoryBuffer& operator=(SharedMemoryBuffer other) noexcept {
+    std::swap(m_region, other.m_region);
+    return *this;
+  }
+
+  ~SharedMemoryBuffer() {
+    if (m_region != nullptr) {
+      munmap(m_region, sizeof(Region));
+    }
+  }
+
+  void write_next(T const& t) {
+    auto write_index =
+        m_region->header.next_write_index.fetch_add(1,
+                                                     std::memory_order_relaxed);
+    auto& slot = this->slot(write_index);
+    wait_for(slot.sequence, write_index);
+    slot.value = t;
+    publish(slot.sequence, write_index + 1);
+  }
+
+  // Writes t if a slot is free, without waiting for one. Returns false if the
+  // buffer is full.
+  bool try_write_next(T const& t) {
+    auto& next_write_index = m_region->header.next_write_index;
+    auto write_index = next_write_index.load(std::memory_order_relaxed);
+    while (true) {
+      auto lead = sequence_lead(write_index, write_index);
+      if (lead < 0) {
+        return false;
+      }
+      if (lead > 0) {
+        write_index = next_write_index.load(std::memory_order_relaxed);
+      } else if (next_write_index.compare_exchange_weak(
+                     write_index, write_index + 1,
+                     std::memory_order_relaxed)) {
+        break;
+      }
+    }
+    auto& slot = this->slot(write_index);
+    slot.value = t;
+    publish(slot.sequence, write_index + 1);
+    return true;
+  }
+
+  template <typename ReadFunc>
+  void read_next(ReadFunc read_func) {
+    auto read_index =
+        m_region->header.next_read_index.fetch_add(1,
+                                                   std::memory_order_relaxed);
+    auto& slot = this->slot(read_index);
+    wait_for(slot.sequence, read_index + 1);
+    read_func(slot.value);
+    publish(slot.sequence, read_index + N);
+  }
+
+  // Reads the next value if it has been written, without waiting. Returns
+  // false if it has not.
+  template <typename ReadFunc>
+  bool try_read_next(ReadFunc read_func) {
+    auto& next_read_index = m_region->header.next_read_index;
+    auto read_index = next_read_index.load(std::memory_order_relaxed);
+    while (true) {
+      auto lead = sequence_lead(read_index, read_index + 1);
+      if (lead < 0) {
+        return false;
+      }
+      if (lead > 0) {
+        read_index = next_read_index.load(std::memory_order_relaxed);
+      } else if (next_read_index.compare_exchange_weak(
+                     read_index, read_index + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    }
+    auto& slot = this->slot(read_index);
+    read_func(slot.value);
+    publish(slot.sequence, read_index + N);
+    return true;
+  }
+
+ private:
+  struct Header {
+    std::atomic<std::uint64_t> magic;
+    std::uint32_t layout_version;
+    std::uint32_t capacity;
+    std::uint32_t value_size;
+    std::uint32_t value_alignment;
+    alignas(cache_line_size) std::atomic<Ticket> next_write_index;
+    alignas(cache_line_size) std::atomic<Ticket> next_read_index;
+    // The number of threads sleeping, or about to sleep, in FUTEX_WAIT.
+    alignas(cache_line_size) std::atomic<std::uint32_t> n_waiting;
+  };
+
+  struct Slot {
+    std::atomic<Ticket> sequence;
+    T value;
+  };
+
+  struct Region {
+    Header header;
+    std::array<Slot, N> slots;
+  };
+  static_assert(std::is_standard_layout_v<Region>);
+  // The futex system call works on the plain 32-bit integer inside.
+  static_assert(sizeof(std::atomic<Ticket>) == sizeof(std::uint32_t));
+
+  Region* m_region;
+
+  explicit SharedMemoryBuffer(Region* region) : m_region{region} {}
+
+  [[noreturn]] static void throw_errno(char const* what) {
+    throw std::system_error{errno, std::generic_category(), what};
+  }
+
+  // Maps the shared memory object fd refers to, and closes fd.
+  static Region* map(int fd) {
+    auto p = mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fd, 0);
+    auto const error = errno;
+    close(fd);
+    if (p == MAP_FAILED) {
+      throw std::system_error{error, std::generic_category(), "mmap"};
+    }
+    // A new shared memory object is zero-filled, which is a valid state for
+    // the atomics and the trivially copyable values.
+    return std::launder(static_cast<Region*>(p));
+  }
+
+  Slot& slot(Ticket index) { return m_region->slots[index % N]; }
+
+  // How far the sequence number of the slot for index is ahead of
+  // ready_sequence, the number it holds once the slot is ready for index.
+  // Ahead means that another thread, possibly in another process, has
+  // claimed index since it was loaded, so the index is stale; behind means
+  // that the buffer is full or empty.
+  std::int32_t sequence_lead(Ticket index, Ticket ready_sequence) {
+    return static_cast<std::int32_t>(
+        slot(index).sequence.load(std::memory_order_acquire) -
+        ready_sequence);
+  }
+
+  void wait_for(std::atomic<Ticket>& sequence, Ticket expected) {
+    auto& n_waiting = m_region->header.n_waiting;
+    for (int trial = 0;; ++trial) {
+      auto observed = sequence.load(std::memory_order_acquire);
+      if (observed == expected) {
+        return;
+      }
+      if (trial < SpinThenPark::spin_trials) {
+        SpinThenPark::spin();
+        continue;
+      }
+      trial = 0;
+      // Counted before the sequence number is checked again, so that a
+      // thread publishing after the check sees the count and wakes us.
+      n_waiting.fetch_add(1);
+      if (sequence.load() == observed) {
+        futex(sequence, FUTEX_WAIT, observed);
+      }
+      n_waiting.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  void publish(std::atomic<Ticket>& sequence, Ticket value) {
+    sequence.store(value);
+    if (m_region->header.n_waiting.load() != 0) {
+      futex(sequence, FUTEX_WAKE, INT_MAX);
+    }
+  }
+
+  // Not FUTEX_PRIVATE_FLAG, since the waiters may be in other processes.
+  static void futex(std::atomic<Ticket>& word, int op, Ticket value) {
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), op, value,
+            nullptr, nullptr, 0);
+  }
+};
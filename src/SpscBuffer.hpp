@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "BufferPolicies.hpp"
+
+// Circular buffer for exactly one producer thread and one consumer thread.
+//
+// Each side owns one index and only reads the other side's index when its
+// cached copy says the buffer is full (for the producer) or empty (for the
+// consumer). On the common path, writes and reads therefore touch only the
+// calling side's own cache lines and the slot itself.
+template <typename T, int N>
+class SpscBuffer {
+  static_assert((N & (N - 1)) == 0,
+                "N must be a power of 2 to ensure correctness in case of "
+                "integer overflow.");
+
+ public:
+  // Must only be called from the producer thread.
+  void write_next(T t) {
+    auto write_index = m_producer.next_write_index;
+    spinlock([this, write_index]() {
+      return write_index != m_producer.cached_read_index + N or
+             write_index != (m_producer.cached_read_index =
+                                 m_read_index.load(std::memory_order_acquire)) +
+                                N;
+    });
+    m_buffer[write_index % N] = std::move(t);
+    m_producer.next_write_index = write_index + 1;
+    m_write_index.store(write_index + 1, std::memory_order_release);
+  }
+
+  // Must only be called from the consumer thread.
+  template <typename ReadFunc>
+  void read_next(ReadFunc read_func) {
+    auto read_index = m_consumer.next_read_index;
+    spinlock([this, read_index]() {
+      return read_index != m_consumer.cached_write_index or
+             read_index != (m_consumer.cached_write_index =
+                                m_write_index.load(std::memory_order_acquire));
+    });
+    read_func(m_buffer[read_index % N]);
+    m_consumer.next_read_index = read_index + 1;
+    m_read_index.store(read_index + 1, std::memory_order_release);
+  }
+
+ private:
+  // Touched only by the producer.
+  struct alignas(cache_line_size) ProducerState {
+    unsigned int next_write_index{};
+    unsigned int cached_read_index{};
+  };
+  // Touched only by the consumer.
+  struct alignas(cache_line_size) ConsumerState {
+    unsigned int next_read_index{};
+    unsigned int cached_write_index{};
+  };
+
+  std::array<T, N> m_buffer{};
+  alignas(cache_line_size) std::atomic<unsigned int> m_write_index{};
+  alignas(cache_line_size) std::atomic<unsigned int> m_read_index{};
+  ProducerState m_producer{};
+  ConsumerState m_consumer{};
+
+  template <typename Test>
+  void spinlock(Test test_to_pass) {
+    for (int trial = 0; not test_to_pass(); ++trial) {
+      // Try several times, then yield the CPU.
+      if (trial == 8) {
+        trial = 0;
+        using namespace std::chrono_literals;
+        std::this_thread::sleep_for(1ns);
+      }
+    }
+  }
+};
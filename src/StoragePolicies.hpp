@@ -0,0 +1,108 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+#include "BufferPolicies.hpp"
+
+// Storage policies, which decide where the slots of a buffer with
+// dynamic_capacity live.
+//
+// AlignedHeapStorage uses aligned operator new. HugePageStorage maps the slots
+// with mmap, asking for explicit huge pages (MAP_HUGETLB) first and falling
+// back to transparent huge pages (madvise(MADV_HUGEPAGE)) when none are
+// reserved. For rings of several megabytes this cuts the number of TLB entries
+// needed to cover the slots by a factor of 512.
+struct AlignedHeapStorage {
+  using policy_kind = storage_policy_kind;
+
+  static void* allocate(std::size_t bytes, std::size_t alignment) {
+    return ::operator new(bytes, std::align_val_t{alignment});
+  }
+
+  static void deallocate(void* p, std::size_t, std::size_t alignment) {
+    ::operator delete(p, std::align_val_t{alignment});
+  }
+};
+
+struct HugePageStorage {
+  using policy_kind = storage_policy_kind;
+  std::size_t static constexpr huge_page_size = std::size_t{1} << 21;
+
+  // Mappings are page aligned, which satisfies any alignment a slot needs.
+  static constexpr std::size_t mapped_length(std::size_t bytes) {
+    return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+  }
+
+  static void* allocate(std::size_t bytes, std::size_t) {
+    auto length = mapped_length(bytes);
+    auto flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_HUGETLB
+    if (auto p = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                      flags | MAP_HUGETLB, -1, 0);
+        p != MAP_FAILED) {
+      return p;
+    }
+#endif
+    auto p = mmap(nullptr, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (p == MAP_FAILED) {
+      throw std::bad_alloc{};
+    }
+#ifdef MADV_HUGEPAGE
+    // Only a hint; the mapping works without huge pages.
+    madvise(p, length, MADV_HUGEPAGE);
+#endif
+    return p;
+  }
+
+  static void deallocate(void* p, std::size_t bytes, std::size_t) {
+    munmap(p, mapped_length(bytes));
+  }
+};
+
+// A fixed-size array of value-initialized U, allocated through StoragePolicy.
+template <typename U, typename StoragePolicy>
+class HeapArray {
+ public:
+  explicit HeapArray(std::size_t size)
+      : m_size{size},
+        m_data{static_cast<U*>(StoragePolicy::allocate(bytes(), alignment))} {
+    try {
+      std::uninitialized_value_construct_n(m_data, m_size);
+    } catch (...) {
+      StoragePolicy::deallocate(m_data, bytes(), alignment);
+      throw;
+    }
+  }
+
+  HeapArray(HeapArray const&) = delete;
+  HeapArray& operator=(HeapArray const&) = delete;
+
+  ~HeapArray() {
+    std::destroy_n(m_data, m_size);
+    StoragePolicy::deallocate(m_data, bytes(), alignment);
+  }
+
+  U& operator[](std::size_t i) { return m_data[i]; }
+  U const& operator[](std::size_t i) const { return m_data[i]; }
+  U* data() { return m_data; }
+  U* begin() { return m_data; }
+  U* end() { return m_data + m_size; }
+  U const* begin() const { return m_data; }
+  U const* end() const { return m_data + m_size; }
+  std::size_t size() const { return m_size; }
+
+ private:
+  // Cache line aligned, so that the first slot does not share a cache line
+  // with whatever was allocated before it.
+  auto static constexpr alignment = std::max(alignof(U), cache_line_size);
+
+  std::size_t m_size;
+  U* m_data;
+
+  std::size_t bytes() const { return m_size * sizeof(U); }
+};
@@ -2,9 +2,14 @@
 
 #include <array>
 #include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <thread>
 
+#include "BufferPolicies.hpp"
+
 // #define LOGGING
 #ifdef LOGGING
 #include <iostream>
@@ -19,153 +24,133 @@
 #define DEBUG_LOG(message)
 #endif
 
+// Circular buffer for any number of producer and consumer threads, with any
+// capacity N, including capacities that are not a power of 2.
+//
+// Indices are 64-bit tickets that only ever increase, and are reduced modulo N
+// only to address a slot. Tickets from different passes through the buffer
+// therefore never compare equal, and at a billion operations per second they
+// would take centuries to wrap around. Since N is a compile-time constant, the
+// compiler performs the modulo as a multiplication by a precomputed
+// reciprocal rather than as a division.
 template <typename T, int N>
 class ThreadSafeBuffer {
+  static_assert(N > 0, "N must be positive.");
+
  public:
+  std::size_t capacity() const { return N; }
+
   void write_next(T t) {
     DEBUG_LOG("Entered write_next().");
-    int write_index = acquire_write_index();
-    m_buffer[write_index] = std::move(t);
+    auto write_index = acquire_write_index();
+    m_buffer[write_index % N] = std::move(t);
     release_write_index(write_index);
   }
 
   template <typename ReadFunc>
   void read_next(ReadFunc read_func) {
     DEBUG_LOG("Entered read_next().");
-    int read_index = acquire_read_index();
-    read_func(m_buffer[read_index]);
+    auto read_index = acquire_read_index();
+    read_func(m_buffer[read_index % N]);
     release_read_index(read_index);
   }
 
  private:
+  using Ticket = std::uint64_t;
+
   std::array<T, N> m_buffer{};
-  std::atomic<int> m_next_write_index{};
-  std::atomic<int> m_still_writing_index{};
-  std::atomic<int> m_next_read_index{};
-  std::atomic<int> m_still_reading_index{};
-  std::atomic<bool> m_empty{true};
-  std::atomic<bool> m_full{false};
-
-  int acquire_write_index() {
-    int write_index = m_next_write_index.load();
+  alignas(cache_line_size) std::atomic<Ticket> m_next_write_index{};
+  alignas(cache_line_size) std::atomic<Ticket> m_still_writing_index{};
+  alignas(cache_line_size) std::atomic<Ticket> m_next_read_index{};
+  alignas(cache_line_size) std::atomic<Ticket> m_still_reading_index{};
+
+  // As in ThreadSafeBuffer2, slots are published by a release fetch_add on
+  // m_still_writing_index or m_still_reading_index and taken over by an
+  // acquire load of it. Each fetch_add continues the release sequence of the
+  // one before, so the wait for a thread's turn to release can be relaxed.
+  // Nothing orders the relaxed load of a thread's next index against the
+  // load of the other side's counter, so the counter may be older than the
+  // index. The two are compared through their signed difference, so that a
+  // stale counter only makes the buffer look full or empty, and a stale index
+  // passes the check and is then updated by the failing CAS.
+  auto static constexpr relaxed = std::memory_order_relaxed;
+  auto static constexpr acquire = std::memory_order_acquire;
+  auto static constexpr release = std::memory_order_release;
+
+  Ticket acquire_write_index() {
+    auto write_index = m_next_write_index.load(relaxed);
     DEBUG_LOG("Attempting to acquire write index " << write_index
                                                    << output_state());
-    bool expect_true = true;
-    for (int trial = 0;
-         not(((m_empty.load() and
-               m_empty.compare_exchange_strong(expect_true, false)) or
-              (write_index = m_next_write_index.load()) !=
-                  m_still_reading_index.load()) and
-             m_next_write_index.compare_exchange_strong(
-                 write_index, circular_increment(write_index)));
-         ++trial, expect_true = true) {
-      // spinlock
-      if (trial == 8) {
-        trial = 0;
-        using namespace std::chrono_literals;
-        std::this_thread::sleep_for(1ns);
-      }
-    }
+    // A failed CAS updates write_index, so the buffer only looks full if it
+    // is full for the current next write index.
+    spinlock([this, &write_index]() {
+      return static_cast<std::int64_t>(
+                 write_index - m_still_reading_index.load(acquire)) < N and
+             m_next_write_index.compare_exchange_weak(
+                 write_index, write_index + 1, relaxed, relaxed);
+    });
     DEBUG_LOG("Acquired write index " << write_index);
     return write_index;
   }
 
-  void release_write_index(int write_index) {
+  void release_write_index(Ticket write_index) {
     DEBUG_LOG("Entering release_write_index() with write index "
               << write_index << output_state());
-    for (int trial = 0; m_still_writing_index.load() != write_index; ++trial) {
-      // spinlock
-      if (trial == 8) {
-        trial = 0;
-        using namespace std::chrono_literals;
-        std::this_thread::sleep_for(1ns);
-      }
-    }
-    auto new_still_writing_index = circular_increment(write_index);
-    m_still_writing_index.store(new_still_writing_index);
-    if (new_still_writing_index == m_next_read_index.load()) {
-      m_full.store(true);
-      DEBUG_LOG("Filled the buffer at write index " << write_index);
-    }
+    spinlock([this, write_index]() {
+      return m_still_writing_index.load(relaxed) == write_index;
+    });
+    m_still_writing_index.fetch_add(1, release);
     DEBUG_LOG("Released write index " << write_index);
   }
 
-  int acquire_read_index() {
-    int read_index = m_next_read_index.load();
+  Ticket acquire_read_index() {
+    auto read_index = m_next_read_index.load(relaxed);
     DEBUG_LOG("Attempting to acquire read index " << read_index
                                                   << output_state());
-    bool expect_true = true;
-    for (int trial = 0; not(((m_full.load() and m_full.compare_exchange_strong(
-                                                    expect_true, false)) or
-                             (read_index = m_next_read_index.load()) !=
-                                 m_still_writing_index.load()) and
-                            m_next_read_index.compare_exchange_strong(
-                                read_index, circular_increment(read_index)));
-         ++trial, expect_true = true) {
-      // spinlock
-      if (trial == 8) {
-        trial = 0;
-        using namespace std::chrono_literals;
-        std::this_thread::sleep_for(1ns);
-      }
-    }
+    spinlock([this, &read_index]() {
+      return static_cast<std::int64_t>(m_still_writing_index.load(acquire) -
+                                       read_index) > 0 and
+             m_next_read_index.compare_exchange_weak(
+                 read_index, read_index + 1, relaxed, relaxed);
+    });
     DEBUG_LOG("Acquired read index " << read_index);
     return read_index;
   }
 
-  void release_read_index(int read_index) {
+  void release_read_index(Ticket read_index) {
     DEBUG_LOG("Entering release_read_index() with read index "
               << read_index << output_state());
-    for (int trial = 0; m_still_reading_index.load() != read_index; ++trial) {
-      // spinlock
+    spinlock([this, read_index]() {
+      return m_still_reading_index.load(relaxed) == read_index;
+    });
+    m_still_reading_index.fetch_add(1, release);
+    DEBUG_LOG("Released read index " << read_index);
+  }
+
+  template <typename Test>
+  void spinlock(Test test_to_pass) {
+    for (int trial = 0; not test_to_pass(); ++trial) {
+      // Try several times, then yield the CPU.
       if (trial == 8) {
         trial = 0;
         using namespace std::chrono_literals;
         std::this_thread::sleep_for(1ns);
       }
     }
-    auto new_still_reading_index = circular_increment(read_index);
-    m_still_reading_index.store(new_still_reading_index);
-    if (new_still_reading_index == m_next_write_index.load()) {
-      m_empty.store(true);
-      DEBUG_LOG("Emptied the buffer at read index " << read_index);
-    }
-    DEBUG_LOG("Released read index " << read_index);
   }
 
   auto output_state() {
-    auto next_write = m_next_write_index.load();
-    auto still_writing = m_still_writing_index.load();
-    auto next_read = m_next_read_index.load();
-    auto still_reading = m_still_reading_index.load();
-    auto empty = m_empty.load();
-    auto full = m_full.load();
+    auto next_write = m_next_write_index.load(relaxed);
+    auto still_writing = m_still_writing_index.load(relaxed);
+    auto next_read = m_next_read_index.load(relaxed);
+    auto still_reading = m_still_reading_index.load(relaxed);
 
     auto state_str = std::string{"; Current state:"};
     state_str += std::string{" nw="} + std::to_string(next_write);
     state_str += std::string{" sw="} + std::to_string(still_writing);
     state_str += std::string{" nr="} + std::to_string(next_read);
     state_str += std::string{" sr="} + std::to_string(still_reading);
-    state_str += std::string{" e="} + std::to_string(empty);
-    state_str += std::string{" f="} + std::to_string(full);
 
     return state_str;
   }
-
-  // TODO: Keeping indices in the range [0, N) ensures correctness of the
-  // increment operation for N not a power of 2, since integer overflow would
-  // cause an error in such cases. However, in a multithreaded setting, wrapping
-  // the indices allows multiple threads to access the same index
-  // simultaneously, since there is no distinction between subsequent passes
-  // through the buffer. To ensure correctness, the index needs to not only be
-  // kept in the range [0, N), but also tagged with the pass number so that
-  // indices referring to the same location but from different passes do not
-  // compare equal.
-  auto static constexpr circular_increment(int i) {
-    if constexpr ((N & (N - 1)) == 0) {  // if N is power of 2
-      return (i + 1) % N;  // performed with bitwise-and mask for power of 2.
-    } else {
-      return ++i < N ? i : 0;
-    }
-  }
 };
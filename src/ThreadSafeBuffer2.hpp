@@ -1,135 +1,1059 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <atomic>
-#include <string>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <new>
+#include <ranges>
+#include <span>
+#include <stdexcept>
 #include <thread>
+#include <type_traits>
+#include <utility>
 
-// #define LOGGING
-#ifdef LOGGING
-#include <iostream>
-#include <sstream>
-#define DEBUG_LOG(message)            \
-  {                                   \
-    std::stringstream output_stream;  \
-    output_stream << message << '\n'; \
-    std::cout << output_stream.str(); \
-  }
-#else
-#define DEBUG_LOG(message)
-#endif
-
-template <typename T, int N>
+#include "AsyncWaiters.hpp"
+#include "BufferPolicies.hpp"
+#include "BufferStats.hpp"
+#include "LatencyHistogram.hpp"
+#include "StoragePolicies.hpp"
+
+template <typename T, int N, BufferPolicy... Policies>
 class ThreadSafeBuffer2 {
-  static_assert((N & (N - 1)) == 0,
+  static_assert(N >= 0 and (N & (N - 1)) == 0,
                 "N must be a power of 2 to ensure correctness in case of "
                 "integer overflow.");
+  static_assert((PolicyOfKind<Policies, release_policy_kind,
+                              layout_policy_kind, memory_order_policy_kind,
+                              wait_policy_kind, storage_policy_kind,
+                              ticket_policy_kind, stats_policy_kind,
+                              latency_policy_kind, overflow_policy_kind,
+                              async_policy_kind> and
+                 ...),
+                "Unknown policy kind.");
+
+  using ReleasePolicy =
+      select_policy_t<release_policy_kind, InOrderRelease, Policies...>;
+  using LayoutPolicy =
+      select_policy_t<layout_policy_kind, PackedLayout, Policies...>;
+  using MemoryOrderPolicy =
+      select_policy_t<memory_order_policy_kind, AcquireReleaseOrdering,
+                      Policies...>;
+  using WaitPolicy =
+      select_policy_t<wait_policy_kind, SpinThenSleep, Policies...>;
+  using StoragePolicy =
+      select_policy_t<storage_policy_kind, AlignedHeapStorage, Policies...>;
+  using TicketPolicy =
+      select_policy_t<ticket_policy_kind, Tickets64, Policies...>;
+  using Ticket = typename TicketPolicy::ticket_type;
+  using StatsPolicy = select_policy_t<stats_policy_kind, NoStats, Policies...>;
+  using LatencyPolicy =
+      select_policy_t<latency_policy_kind, NoLatencyTracing, Policies...>;
+  using OverflowPolicy =
+      select_policy_t<overflow_policy_kind, BlockWhenFull, Policies...>;
+  using AsyncPolicy =
+      select_policy_t<async_policy_kind, NoAsyncWaiters, Policies...>;
+
+  auto static constexpr per_slot_sequence =
+      std::is_same_v<ReleasePolicy, PerSlotSequence>;
+  auto static constexpr dynamic = N == dynamic_capacity;
+  auto static constexpr index_alignment =
+      LayoutPolicy::pad_indices ? cache_line_size
+                                : alignof(std::atomic<Ticket>);
+
+  // Slot contents are handed from writer to reader, and back, by a release
+  // operation on the counter or sequence number that publishes the slot and
+  // an acquire load of it by the next owner. Loads of a thread's own next
+  // index and the CAS that claims it are relaxed, so nothing orders them
+  // against the load of the other side's counter: the counter may be older
+  // than the index, even far enough behind that the unsigned difference
+  // wraps. Counts of free or ready slots are therefore taken as signed
+  // differences and clamped at 0, so that a stale counter only makes a claim
+  // fail, never succeed for a slot that is not yet free or ready.
+  // In InOrderRelease, each fetch_add continues the release sequence of the
+  // previous one, so the spin waiting for a thread's turn can also be relaxed.
+  auto static constexpr relaxed = MemoryOrderPolicy::relaxed;
+  auto static constexpr acquire = MemoryOrderPolicy::acquire;
+  auto static constexpr release = MemoryOrderPolicy::release;
 
  public:
-  void write_next(T t) {
-    DEBUG_LOG("Entered write_next().");
+  using ticket_type = Ticket;
+
+  ThreadSafeBuffer2()
+    requires(not dynamic)
+  {
+    initialize_slots();
+  }
+
+  // With N = dynamic_capacity, the capacity is min_capacity rounded up to a
+  // power of 2, and the slots are allocated according to the storage policy.
+  explicit ThreadSafeBuffer2(std::size_t min_capacity)
+    requires dynamic
+      : m_buffer{checked_capacity(min_capacity)} {
+    initialize_slots();
+  }
+
+  ThreadSafeBuffer2(ThreadSafeBuffer2 const&) = delete;
+  ThreadSafeBuffer2& operator=(ThreadSafeBuffer2 const&) = delete;
+
+  // Destroys the values that were written but not read. No other thread may
+  // be using the buffer.
+  ~ThreadSafeBuffer2() {
+    if constexpr (not std::is_trivially_destructible_v<T>) {
+      for (auto i = m_next_read_index.load(relaxed);
+           i != m_next_write_index.load(relaxed); ++i) {
+        std::destroy_at(&slot(i).value());
+      }
+    }
+  }
+
+  std::size_t capacity() const { return n_slots(); }
+
+  // The number of values in the buffer, including values that are still being
+  // written or read. Wait-free and read-only, but other threads may have
+  // changed the number by the time it returns.
+  std::size_t size_approx() const {
+    // The two relaxed loads are unordered, so the write index may be older
+    // than the read index and the difference negative, which is taken as
+    // empty. Writes and reads between the loads can also make it exceed the
+    // capacity, which is taken as full.
+    auto difference = static_cast<std::make_signed_t<Ticket>>(
+        m_next_write_index.load(relaxed) - m_next_read_index.load(relaxed));
+    auto size = std::min<std::size_t>(
+        static_cast<std::size_t>(
+            std::max<std::make_signed_t<Ticket>>(difference, 0)),
+        n_slots());
+    return size;
+  }
+
+  bool empty() const { return size_approx() == 0u; }
+  bool full() const { return size_approx() == capacity(); }
+
+  // As size_approx(), but also raises high_watermark() to the size. Unlike the
+  // read-only queries, this writes to a shared cache line, so it is meant for
+  // a monitoring thread that samples the size now and then.
+  std::size_t sample_size() {
+    auto size = size_approx();
+    auto watermark = m_high_watermark.load(relaxed);
+    while (size > watermark and
+           not m_high_watermark.compare_exchange_weak(watermark, size, relaxed,
+                                                      relaxed)) {
+    }
+    return size;
+  }
+
+  // The largest size sample_size() has seen since construction or the last
+  // reset_high_watermark(). Only sizes seen by those calls count, so peaks
+  // between them are missed; ShardedStats records every peak, at a cost on
+  // every write.
+  std::size_t high_watermark() const { return m_high_watermark.load(relaxed); }
+
+  // Returns high_watermark() and restarts it from zero.
+  std::size_t reset_high_watermark() {
+    return m_high_watermark.exchange(0u, relaxed);
+  }
+
+  // With OverwriteOldest, the number of values that writers have discarded
+  // unread to make room.
+  std::uint64_t dropped_count() const
+    requires OverflowPolicy::overwrite_oldest
+  {
+    return m_dropped_count.load(relaxed);
+  }
+
+  // The counters kept with a ShardedStats policy, summed over all threads.
+  BufferStatsSnapshot stats_snapshot() const
+    requires StatsPolicy::enabled
+  {
+    return m_stats.snapshot();
+  }
+
+  // With a LatencyTracing policy, how long values waited in the buffer, from
+  // being published by their writer to being claimed by their reader, merged
+  // over all reading threads.
+  LatencyHistogram latency_histogram() const
+    requires LatencyPolicy::enabled
+  {
+    return m_latency.merged();
+  }
+
+  // Moves the indices of an empty buffer forward to first_ticket, as though
+  // first_ticket values had been written and read, so that tests can reach
+  // ticket wrap-around without that many operations. No other thread may be
+  // using the buffer.
+  void fast_forward(Ticket first_ticket) {
+    for (auto* index : {&m_next_write_index, &m_still_writing_index,
+                        &m_next_read_index, &m_still_reading_index}) {
+      index->store(first_ticket, relaxed);
+    }
+    if constexpr (per_slot_sequence) {
+      for (auto i = Ticket{}; i < n_slots(); ++i) {
+        slot(first_ticket + i).sequence.store(first_ticket + i, relaxed);
+      }
+    }
+  }
+
+  void write_next(T t) { emplace_next(std::move(t)); }
+
+  // Constructs the next value from args directly in its slot, waiting for a
+  // free slot as needed.
+  template <typename... Args>
+    requires std::constructible_from<T, Args&&...>
+  void emplace_next(Args&&... args) {
     auto write_index = acquire_write_index();
-    m_buffer[write_index % N] = std::move(t);
+    std::construct_at(&slot(write_index).value(), std::forward<Args>(args)...);
     release_write_index(write_index);
   }
 
+  // A free slot claimed by claim_write(). The producer constructs the value in
+  // place with emplace(), fills it in through the returned reference, and then
+  // publishes it with commit(). A claim that goes out of scope uncommitted is
+  // committed then, so that the slot is not lost, with a value-initialized T
+  // in place of a value that was never emplaced. If the claim goes out of
+  // scope because the producer threw, the emplaced value may be half filled
+  // in, so it too is replaced by a value-initialized T. A T that cannot be
+  // value-initialized is published as emplaced, and if nothing was emplaced,
+  // std::terminate() is called, as there is no value to publish.
+  class WriteClaim {
+   public:
+    WriteClaim(WriteClaim const&) = delete;
+    WriteClaim& operator=(WriteClaim const&) = delete;
+
+    ~WriteClaim() {
+      if (not m_committed) {
+        auto const unwinding =
+            std::uncaught_exceptions() > m_uncaught_exceptions;
+        if constexpr (std::default_initializable<T>) {
+          if (not m_constructed or unwinding) {
+            auto* value = &m_buffer.slot(m_index).value();
+            if (m_constructed) {
+              std::destroy_at(value);
+            }
+            std::construct_at(value);
+          }
+        } else if (not m_constructed) {
+          std::terminate();
+        }
+        commit();
+      }
+    }
+
+    // Constructs the value from args in the claimed slot, replacing any value
+    // emplaced before. With no arguments, the value is default-initialized,
+    // so a trivial T is left for the producer to fill in.
+    template <typename... Args>
+      requires std::constructible_from<T, Args&&...>
+    T& emplace(Args&&... args) {
+      auto* value = &m_buffer.slot(m_index).value();
+      if (m_constructed) {
+        std::destroy_at(value);
+        m_constructed = false;
+      }
+      if constexpr (sizeof...(Args) == 0u) {
+        ::new (static_cast<void*>(value)) T;
+      } else {
+        std::construct_at(value, std::forward<Args>(args)...);
+      }
+      m_constructed = true;
+      return *value;
+    }
+
+    // Publishes the emplaced value to readers. Must be called at most once,
+    // after emplace().
+    void commit() {
+      m_committed = true;
+      m_buffer.release_write_index(m_index);
+    }
+
+   private:
+    friend class ThreadSafeBuffer2;
+
+    WriteClaim(ThreadSafeBuffer2& buffer, Ticket index)
+        : m_buffer{buffer}, m_index{index} {}
+
+    ThreadSafeBuffer2& m_buffer;
+    Ticket m_index;
+    int m_uncaught_exceptions{std::uncaught_exceptions()};
+    bool m_constructed{};
+    bool m_committed{};
+  };
+
+  // Waits for a free slot and claims it for the caller to fill in place,
+  // avoiding the move into the slot that write_next makes.
+  WriteClaim claim_write() {
+    return WriteClaim{*this, acquire_write_index()};
+  }
+
   template <typename ReadFunc>
   void read_next(ReadFunc read_func) {
-    DEBUG_LOG("Entered read_next().");
     auto read_index = acquire_read_index();
-    read_func(m_buffer[read_index % N]);
+    read_func(slot(read_index).value());
+    std::destroy_at(&slot(read_index).value());
     release_read_index(read_index);
   }
 
- private:
-  std::array<T, N> m_buffer{};
-  std::atomic<unsigned int> m_next_write_index{};
-  std::atomic<unsigned int> m_still_writing_index{};
-  std::atomic<unsigned int> m_next_read_index{};
-  std::atomic<unsigned int> m_still_reading_index{};
-
-  int acquire_write_index() {
-    auto write_index = m_next_write_index.load();
-    DEBUG_LOG("Attempting to acquire write index " << write_index << " ("
-                                                   << write_index % N << ")"
-                                                   << output_state());
+  // Writes t if a slot is free, without waiting for one. Returns false, leaving
+  // t untouched, if the buffer is full. With InOrderRelease, a successful
+  // write still waits for writers holding earlier indices to release them.
+  template <typename U>
+    requires std::constructible_from<T, U&&>
+  bool try_write_next(U&& t) {
+    auto write_index = Ticket{};
+    if (try_acquire_write_indices(write_index, 1u) == 0u) {
+      return false;
+    }
+    std::construct_at(&slot(write_index).value(), std::forward<U>(t));
+    release_write_index(write_index);
+    return true;
+  }
+
+  // A slot claimed by claim_read(), holding the next value. The value can be
+  // processed through the claim for as long as needed; it is destroyed, and
+  // its slot handed back to writers, by release() or when the claim goes out
+  // of scope.
+  //
+  // With PerSlotSequence, each claim is released independently of the others.
+  // With InOrderRelease, a release waits until all earlier claims have been
+  // released, so a thread holding several claims must release them in the
+  // order it made them.
+  class ReadClaim {
+   public:
+    ReadClaim(ReadClaim&& other) noexcept
+        : m_buffer{other.m_buffer},
+          m_index{other.m_index},
+          m_released{std::exchange(other.m_released, true)} {}
+
+    ~ReadClaim() {
+      if (not m_released) {
+        release();
+      }
+    }
+
+    T& operator*() const { return m_buffer->slot(m_index).value(); }
+    T* operator->() const { return &**this; }
+
+    // Destroys the value and releases the slot. Must be called at most once.
+    void release() {
+      m_released = true;
+      std::destroy_at(&**this);
+      m_buffer->release_read_index(m_index);
+    }
+
+   private:
+    friend class ThreadSafeBuffer2;
+
+    ReadClaim(ThreadSafeBuffer2& buffer, Ticket index)
+        : m_buffer{&buffer}, m_index{index} {}
+
+    ThreadSafeBuffer2* m_buffer;
+    Ticket m_index;
+    bool m_released{};
+  };
+
+  // Waits for the next value and claims its slot, leaving the value in place
+  // until the claim is released.
+  ReadClaim claim_read() {
+    return ReadClaim{*this, acquire_read_index()};
+  }
+
+  // Waits for the next value and moves it into out, releasing its slot before
+  // returning, so that processing the value afterwards holds up no other
+  // reader or writer.
+  void consume_into(T& out)
+    requires std::is_move_assignable_v<T>
+  {
+    auto read_index = acquire_read_index();
+    out = std::move(slot(read_index).value());
+    std::destroy_at(&slot(read_index).value());
+    release_read_index(read_index);
+  }
+
+  // Reads the next value if there is one, without waiting. Returns false if
+  // the buffer is empty.
+  template <typename ReadFunc>
+  bool try_read_next(ReadFunc read_func) {
+    auto read_index = Ticket{};
+    if (try_acquire_read_indices(read_index, 1u) == 0u) {
+      return false;
+    }
+    read_func(slot(read_index).value());
+    std::destroy_at(&slot(read_index).value());
+    release_read_index(read_index);
+    return true;
+  }
+
+  // As write_next, but gives up waiting for a free slot once deadline has
+  // passed. Returns false, leaving t untouched, if it gave up.
+  template <typename U, typename Clock, typename Duration>
+    requires std::constructible_from<T, U&&>
+  bool write_until(U&& t,
+                   std::chrono::time_point<Clock, Duration> const& deadline) {
+    auto write_index = Ticket{};
     auto index_acquired = [this, &write_index]() {
-      return (((write_index = m_next_write_index.load()) !=
-               m_still_reading_index.load() + N) and
-              m_next_write_index.compare_exchange_strong(write_index,
-                                                         write_index + 1));
+      return try_acquire_write_indices(write_index, 1u) == 1u;
     };
-    spinlock(index_acquired);
-    DEBUG_LOG("Acquired write index " << write_index << " (" << write_index % N
-                                      << ")");
-    return write_index;
+    if (not spinlock_until(index_acquired, deadline)) {
+      return false;
+    }
+    std::construct_at(&slot(write_index).value(), std::forward<U>(t));
+    release_write_index(write_index);
+    return true;
   }
 
-  void release_write_index(unsigned int write_index) {
-    DEBUG_LOG("Entering release_write_index() with write index "
-              << write_index << " (" << write_index % N << ")"
-              << output_state());
-    spinlock([this, write_index]() {
-      return m_still_writing_index.load() == write_index;
-    });
-    m_still_writing_index.fetch_add(1u);
-    DEBUG_LOG("Released write index " << write_index << " (" << write_index % N
-                                      << ")");
+  template <typename U, typename Rep, typename Period>
+    requires std::constructible_from<T, U&&>
+  bool write_for(U&& t, std::chrono::duration<Rep, Period> const& timeout) {
+    return write_until(std::forward<U>(t),
+                       std::chrono::steady_clock::now() + timeout);
   }
 
-  int acquire_read_index() {
-    auto read_index = m_next_read_index.load();
-    DEBUG_LOG("Attempting to acquire read index "
-              << read_index << " (" << read_index % N << ")" << output_state());
+  // As read_next, but gives up waiting for a value once deadline has passed.
+  // Returns false if it gave up.
+  template <typename ReadFunc, typename Clock, typename Duration>
+  bool read_until(ReadFunc read_func,
+                  std::chrono::time_point<Clock, Duration> const& deadline) {
+    auto read_index = Ticket{};
     auto index_acquired = [this, &read_index]() {
-      return (((read_index = m_next_read_index.load()) !=
-               m_still_writing_index.load()) and
-              m_next_read_index.compare_exchange_strong(read_index,
-                                                        read_index + 1));
+      return try_acquire_read_indices(read_index, 1u) == 1u;
     };
-    spinlock(index_acquired);
-    DEBUG_LOG("Acquired read index " << read_index << " (" << read_index % N
-                                     << ")");
+    if (not spinlock_until(index_acquired, deadline)) {
+      return false;
+    }
+    read_func(slot(read_index).value());
+    std::destroy_at(&slot(read_index).value());
+    release_read_index(read_index);
+    return true;
+  }
+
+  template <typename ReadFunc, typename Rep, typename Period>
+  bool read_for(ReadFunc read_func,
+                std::chrono::duration<Rep, Period> const& timeout) {
+    return read_until(read_func, std::chrono::steady_clock::now() + timeout);
+  }
+
+  // Moves all of values into the buffer, waiting for space as needed. Each
+  // atomic claim takes as many consecutive slots as are free at the time.
+  void write_bulk(std::span<T> values) {
+    while (not values.empty()) {
+      auto write_index = Ticket{};
+      auto count = 0u;
+      spinlock(
+          [this, &write_index, &count, &values]() {
+            return (count = try_acquire_write_indices(
+                        write_index, max_claim(values.size()))) != 0u;
+          },
+          [this, &write_index]() -> auto& {
+            return space_wait_target(write_index);
+          });
+      write_claimed(write_index, values.first(count));
+      values = values.subspan(count);
+    }
+  }
+
+  // Moves as many of values into the buffer as fit without waiting for space,
+  // with a single claim. Returns the number of values written.
+  std::size_t try_write_up_to(std::span<T> values) {
+    auto write_index = Ticket{};
+    auto count = try_acquire_write_indices(write_index,
+                                           max_claim(values.size()));
+    if (count != 0u) {
+      write_claimed(write_index, values.first(count));
+    }
+    return count;
+  }
+
+  // Waits until at least one value can be read, then claims up to max_count
+  // values with a single atomic operation. The claimed values are passed to
+  // read_func as one or two random-access ranges of T& (two when the claim
+  // wraps around the end of the buffer). Returns the number of values read.
+  template <typename ReadFunc>
+  std::size_t read_bulk(ReadFunc read_func, std::size_t max_count) {
+    if (max_count == 0u) {
+      return 0u;
+    }
+    auto read_index = Ticket{};
+    auto count = 0u;
+    spinlock(
+        [this, &read_index, &count, max_count]() {
+          return (count = try_acquire_read_indices(
+                      read_index, max_claim(max_count))) != 0u;
+        },
+        [this, &read_index]() -> auto& {
+          return data_wait_target(read_index);
+        });
+    auto [first, second] = values_in(read_index, count);
+    read_func(first);
+    if (not second.empty()) {
+      read_func(second);
+    }
+    for (auto i = read_index; i != read_index + count; ++i) {
+      std::destroy_at(&slot(i).value());
+    }
+    release_read_indices(read_index, count);
+    return count;
+  }
+
+  // Awaitable returned by async_write().
+  class WriteAwaiter : public AsyncWaiter {
+   public:
+    bool await_ready() { return try_claim(); }
+    bool await_suspend(std::coroutine_handle<> handle) {
+      m_handle = handle;
+      return not m_buffer.claim_or_wait(*this, m_buffer.m_async_waiters.space);
+    }
+    void await_resume() {
+      std::construct_at(&m_buffer.slot(m_index).value(), std::move(m_value));
+      m_buffer.release_write_index(m_index);
+    }
+
+   private:
+    friend class ThreadSafeBuffer2;
+
+    WriteAwaiter(ThreadSafeBuffer2& buffer, T&& value)
+        : AsyncWaiter{retry}, m_buffer{buffer}, m_value{std::move(value)} {}
+
+    bool try_claim() {
+      return m_buffer.try_acquire_write_indices(m_index, 1u) == 1u;
+    }
+    static bool may_claim(ThreadSafeBuffer2& buffer) {
+      return buffer.may_acquire_write_index();
+    }
+
+    static void retry(AsyncWaiter& waiter) {
+      auto& self = static_cast<WriteAwaiter&>(waiter);
+      auto& buffer = self.m_buffer;
+      if (buffer.claim_or_wait(self, buffer.m_async_waiters.space)) {
+        self.m_handle.resume();
+      }
+    }
+
+    ThreadSafeBuffer2& m_buffer;
+    T m_value;
+    Ticket m_index{};
+    std::coroutine_handle<> m_handle;
+  };
+
+  // Awaitable returned by async_read().
+  class ReadAwaiter : public AsyncWaiter {
+   public:
+    bool await_ready() { return try_claim(); }
+    bool await_suspend(std::coroutine_handle<> handle) {
+      m_handle = handle;
+      return not m_buffer.claim_or_wait(*this, m_buffer.m_async_waiters.data);
+    }
+    T await_resume() {
+      auto& value = m_buffer.slot(m_index).value();
+      auto result = std::move(value);
+      std::destroy_at(&value);
+      m_buffer.release_read_index(m_index);
+      return result;
+    }
+
+   private:
+    friend class ThreadSafeBuffer2;
+
+    explicit ReadAwaiter(ThreadSafeBuffer2& buffer)
+        : AsyncWaiter{retry}, m_buffer{buffer} {}
+
+    bool try_claim() {
+      return m_buffer.try_acquire_read_indices(m_index, 1u) == 1u;
+    }
+    static bool may_claim(ThreadSafeBuffer2& buffer) {
+      return buffer.may_acquire_read_index();
+    }
+
+    static void retry(AsyncWaiter& waiter) {
+      auto& self = static_cast<ReadAwaiter&>(waiter);
+      auto& buffer = self.m_buffer;
+      if (buffer.claim_or_wait(self, buffer.m_async_waiters.data)) {
+        self.m_handle.resume();
+      }
+    }
+
+    ThreadSafeBuffer2& m_buffer;
+    Ticket m_index{};
+    std::coroutine_handle<> m_handle;
+  };
+
+  // With an AsyncWaiters policy, co_await async_write(t) writes t, suspending
+  // the coroutine rather than blocking its thread while the buffer is full.
+  // A suspended coroutine is resumed on the thread whose release let its
+  // claim succeed, inside that thread's write or read call, so a coroutine
+  // that must run on its executor should reschedule itself there. A
+  // suspended coroutine must not be destroyed. With OverwriteOldest, writes
+  // do not wait for readers, so use write_next.
+  WriteAwaiter async_write(T t)
+    requires AsyncPolicy::enabled and (not OverflowPolicy::overwrite_oldest)
+  {
+    return WriteAwaiter{*this, std::move(t)};
+  }
+
+  // As async_write, but co_await async_read() reads the next value, suspending
+  // the coroutine while the buffer is empty.
+  ReadAwaiter async_read()
+    requires AsyncPolicy::enabled
+  {
+    return ReadAwaiter{*this};
+  }
+
+ private:
+  unsigned int n_slots() const {
+    return static_cast<unsigned int>(m_buffer.size());
+  }
+
+  auto& slot(Ticket index) { return m_buffer[index & (n_slots() - 1)]; }
+
+  static std::size_t checked_capacity(std::size_t min_capacity) {
+    auto capacity = std::bit_ceil(std::max(min_capacity, std::size_t{1}));
+    if (capacity > std::size_t{1} << 31) {
+      throw std::length_error{"ThreadSafeBuffer2 capacity too large"};
+    }
+    return capacity;
+  }
+
+  void initialize_slots() {
+    if constexpr (per_slot_sequence) {
+      for (auto i = 0u; i < n_slots(); ++i) {
+        m_buffer[i].sequence.store(i, relaxed);
+      }
+    }
+    if constexpr (LatencyPolicy::enabled) {
+      LatencyPolicy::calibrate_clock();
+    }
+  }
+
+  auto max_claim(std::size_t count) const {
+    return static_cast<unsigned int>(std::min(count, capacity()));
+  }
+
+  void write_claimed(Ticket write_index, std::span<T> values) {
+    for (auto i = write_index; auto& value : values) {
+      std::construct_at(&slot(i++).value(), std::move(value));
+    }
+    release_write_indices(write_index, values.size());
+  }
+
+  struct NoSequence {};
+  struct NoTimestamp {};
+  struct NoDropCount {};
+  struct PackedSlot {
+    // With PerSlotSequence, a slot holding sequence number s is ready to be
+    // written for index s and ready to be read for index s - 1.
+    [[no_unique_address]] std::conditional_t<
+        per_slot_sequence, std::atomic<Ticket>, NoSequence> sequence{};
+    // With LatencyTracing, when the value was published.
+    [[no_unique_address]] std::conditional_t<
+        LatencyPolicy::enabled, std::uint64_t, NoTimestamp> published_at{};
+    // Holds a value only between its write and its read, so T need not be
+    // default constructible and writes construct rather than assign.
+    alignas(T) std::byte storage[sizeof(T)]{};
+
+    T& value() { return *std::launder(reinterpret_cast<T*>(storage)); }
+  };
+  struct alignas(std::max(cache_line_size, alignof(PackedSlot))) PaddedSlot
+      : PackedSlot {};
+  using Slot = std::conditional_t<LayoutPolicy::pad_slots, PaddedSlot,
+                                  PackedSlot>;
+
+  using Storage = std::conditional_t<dynamic, HeapArray<Slot, StoragePolicy>,
+                                     std::array<Slot, N>>;
+
+  Storage m_buffer{};
+  alignas(index_alignment) std::atomic<Ticket> m_next_write_index{};
+  alignas(index_alignment) std::atomic<Ticket> m_still_writing_index{};
+  alignas(index_alignment) std::atomic<Ticket> m_next_read_index{};
+  alignas(index_alignment) std::atomic<Ticket> m_still_reading_index{};
+  [[no_unique_address]] typename StatsPolicy::Counters m_stats{};
+  [[no_unique_address]] typename LatencyPolicy::Histograms m_latency{};
+  // Only touched by sample_size() and reset_high_watermark(), so kept off the
+  // counters' cache lines when those are padded.
+  alignas(index_alignment) std::atomic<std::size_t> m_high_watermark{};
+  [[no_unique_address]] std::conditional_t<OverflowPolicy::overwrite_oldest,
+                                           std::atomic<std::uint64_t>,
+                                           NoDropCount> m_dropped_count{};
+  [[no_unique_address]] typename AsyncPolicy::WaiterLists m_async_waiters{};
+
+  Ticket acquire_write_index() {
+    auto write_index = m_next_write_index.load(relaxed);
+    spinlock(
+        [this, &write_index]() {
+          return try_acquire_write_indices(write_index, 1u) == 1u;
+        },
+        [this, &write_index]() -> auto& {
+          return space_wait_target(write_index);
+        });
+    return write_index;
+  }
+
+  void release_write_index(Ticket write_index) {
+    release_write_indices(write_index, 1u);
+  }
+
+  Ticket acquire_read_index() {
+    auto read_index = m_next_read_index.load(relaxed);
+    spinlock(
+        [this, &read_index]() {
+          return try_acquire_read_indices(read_index, 1u) == 1u;
+        },
+        [this, &read_index]() -> auto& {
+          return data_wait_target(read_index);
+        });
     return read_index;
   }
 
-  void release_read_index(unsigned int read_index) {
-    DEBUG_LOG("Entering release_read_index() with read index "
-              << read_index << " (" << read_index % N << ")" << output_state());
-    spinlock([this, read_index]() {
-      return m_still_reading_index.load() == read_index;
-    });
-    m_still_reading_index.fetch_add(1u);
-    DEBUG_LOG("Released read index " << read_index << " (" << read_index % N
-                                     << ")");
+  void release_read_index(Ticket read_index) {
+    release_read_indices(read_index, 1u);
   }
 
-  template <typename Test>
-  void spinlock(Test test_to_pass) {
-    for (int trial = 0; not test_to_pass(); ++trial) {
-      // Try several times, then yield the CPU. This method performs well when
-      // each thread is expected to wait a short time. Replace with mutex if
-      // long wait times are expected.
-      if (trial == 8) {
-        trial = 0;
-        using namespace std::chrono_literals;
-        std::this_thread::sleep_for(1ns);
+  // Claims up to max_count (at most the capacity) consecutive write indices
+  // with a single CAS, setting write_index to the first one. Returns the
+  // number of indices claimed, which is 0 only if the buffer is full. Losing
+  // the CAS to another writer is retried here rather than reported as a
+  // failure.
+  unsigned int try_acquire_write_indices(Ticket& write_index,
+                                         unsigned int max_count) {
+    write_index = m_next_write_index.load(relaxed);
+    while (true) {
+      auto count = writable_count(write_index, max_count);
+      if (count == 0u and is_stale(write_index, write_index)) {
+        write_index = m_next_write_index.load(relaxed);
+        continue;
+      }
+      if constexpr (OverflowPolicy::overwrite_oldest) {
+        if (count == 0u and is_full(write_index) and drop_oldest()) {
+          write_index = m_next_write_index.load(relaxed);
+          continue;
+        }
+      }
+      if (count == 0u) {
+        m_stats.record(BufferCounter::full_stalls);
+        return count;
+      }
+      if (m_next_write_index.compare_exchange_weak(
+              write_index, write_index + count, relaxed, relaxed)) {
+        return count;
+      }
+      m_stats.record(BufferCounter::cas_failures);
+    }
+  }
+
+  // With PerSlotSequence, whether the sequence number of the slot for index is
+  // ahead of ready_sequence, the number it holds once the slot is ready for
+  // index. Another thread has then claimed index since it was loaded, so the
+  // index is stale, rather than the buffer full or empty as when the sequence
+  // number is behind. With InOrderRelease, a stale index is caught by the CAS.
+  bool is_stale(Ticket index, Ticket ready_sequence) {
+    if constexpr (per_slot_sequence) {
+      return static_cast<std::make_signed_t<Ticket>>(
+                 slot(index).sequence.load(acquire) - ready_sequence) > 0;
+    } else {
+      return false;
+    }
+  }
+
+  // Whether the buffer is full for a writer at write_index, with every read
+  // claim released, rather than just waiting for a reader that has yet to
+  // release the slot. Since the write index is at most the read index plus
+  // the capacity, only a current write_index can pass.
+  bool is_full(Ticket write_index) {
+    return static_cast<Ticket>(write_index - m_next_read_index.load(relaxed)) ==
+           n_slots();
+  }
+
+  // Discards the oldest value, claiming it as a reader would, so that the
+  // reader holding its ticket moves on to the next one. Returns false if the
+  // oldest value is still being written. Dropped values are not counted in
+  // the latency histograms. With InOrderRelease, the release waits for
+  // readers holding earlier claims, so the writer can wait on slow readers.
+  bool drop_oldest() {
+    auto read_index = Ticket{};
+    if (try_claim_read_indices(read_index, 1u) == 0u) {
+      return false;
+    }
+    std::destroy_at(&slot(read_index).value());
+    release_read_indices(read_index, 1u);
+    m_dropped_count.fetch_add(1u, relaxed);
+    return true;
+  }
+
+  // The number of consecutive slots, up to max_count, that are free to be
+  // written starting at write_index.
+  unsigned int writable_count(Ticket write_index,
+                              unsigned int max_count) {
+    if constexpr (per_slot_sequence) {
+      auto count = 0u;
+      while (count < max_count and
+             slot(write_index + count).sequence.load(acquire) ==
+                 write_index + count) {
+        ++count;
+      }
+      return count;
+    } else {
+      return clamped_count(
+          m_still_reading_index.load(acquire) + n_slots() - write_index,
+          max_count);
+    }
+  }
+
+  void release_write_indices(Ticket write_index, unsigned int count) {
+    if constexpr (LatencyPolicy::enabled) {
+      auto now = LatencyPolicy::now();
+      for (auto i = write_index; i != write_index + count; ++i) {
+        slot(i).published_at = now;
+      }
+    }
+    m_stats.record(BufferCounter::writes, count);
+    if constexpr (StatsPolicy::enabled) {
+      // Readers cannot claim these slots before they are published, so the
+      // read index is at most write_index here.
+      m_stats.record_occupancy(write_index + count -
+                               m_next_read_index.load(relaxed));
+    }
+    if constexpr (per_slot_sequence) {
+      for (auto i = write_index; i != write_index + count; ++i) {
+        slot(i).sequence.store(i + 1, release);
+        notify(slot(i).sequence);
       }
+    } else {
+      spinlock(
+          [this, write_index]() {
+            return m_still_writing_index.load(relaxed) == write_index;
+          },
+          [this]() -> auto& { return m_still_writing_index; });
+      m_still_writing_index.fetch_add(count, release);
+      notify(m_still_writing_index);
+    }
+    if constexpr (AsyncPolicy::enabled) {
+      m_async_waiters.data.retry_all();
     }
   }
 
-  auto output_state() {
-    auto next_write = m_next_write_index.load();
-    auto still_writing = m_still_writing_index.load();
-    auto next_read = m_next_read_index.load();
-    auto still_reading = m_still_reading_index.load();
+  // Claims up to max_count (at most the capacity) consecutive read indices
+  // with a single CAS, setting read_index to the first one. Returns the number
+  // of indices claimed, which is 0 only if the buffer is empty.
+  unsigned int try_acquire_read_indices(Ticket& read_index,
+                                        unsigned int max_count) {
+    auto count = try_claim_read_indices(read_index, max_count);
+    if constexpr (LatencyPolicy::enabled) {
+      if (count != 0u) {
+        record_latencies(read_index, count);
+      }
+    }
+    return count;
+  }
 
-    auto state_str = std::string{"; Current state:"};
-    state_str += std::string{" nw="} + std::to_string(next_write);
-    state_str += std::string{" sw="} + std::to_string(still_writing);
-    state_str += std::string{" nr="} + std::to_string(next_read);
-    state_str += std::string{" sr="} + std::to_string(still_reading);
+  // As try_acquire_read_indices(), but without recording latencies, for
+  // claims that do not deliver the values to a reader.
+  unsigned int try_claim_read_indices(Ticket& read_index,
+                                      unsigned int max_count) {
+    read_index = m_next_read_index.load(relaxed);
+    while (true) {
+      auto count = readable_count(read_index, max_count);
+      if (count == 0u and is_stale(read_index, read_index + 1)) {
+        read_index = m_next_read_index.load(relaxed);
+        continue;
+      }
+      if (count == 0u) {
+        m_stats.record(BufferCounter::empty_stalls);
+        return count;
+      }
+      if (m_next_read_index.compare_exchange_weak(
+              read_index, read_index + count, relaxed, relaxed)) {
+        return count;
+      }
+      m_stats.record(BufferCounter::cas_failures);
+    }
+  }
+
+  // The number of consecutive slots, up to max_count, that are ready to be
+  // read starting at read_index.
+  unsigned int readable_count(Ticket read_index,
+                              unsigned int max_count) {
+    if constexpr (per_slot_sequence) {
+      auto count = 0u;
+      while (count < max_count and
+             slot(read_index + count).sequence.load(acquire) ==
+                 read_index + count + 1) {
+        ++count;
+      }
+      return count;
+    } else {
+      return clamped_count(m_still_writing_index.load(acquire) - read_index,
+                           max_count);
+    }
+  }
+
+  // difference, the wrapped difference between two tickets, as a count of at
+  // most max_count, or 0 if it is negative.
+  static unsigned int clamped_count(Ticket difference, unsigned int max_count) {
+    auto const signed_difference =
+        static_cast<std::make_signed_t<Ticket>>(difference);
+    if (signed_difference <= 0) {
+      return 0u;
+    }
+    return static_cast<unsigned int>(
+        std::min<Ticket>(max_count, static_cast<Ticket>(signed_difference)));
+  }
+
+  void release_read_indices(Ticket read_index, unsigned int count) {
+    m_stats.record(BufferCounter::reads, count);
+    if constexpr (per_slot_sequence) {
+      for (auto i = read_index; i != read_index + count; ++i) {
+        slot(i).sequence.store(i + n_slots(), release);
+        notify(slot(i).sequence);
+      }
+    } else {
+      spinlock(
+          [this, read_index]() {
+            return m_still_reading_index.load(relaxed) == read_index;
+          },
+          [this]() -> auto& { return m_still_reading_index; });
+      m_still_reading_index.fetch_add(count, release);
+      notify(m_still_reading_index);
+    }
+    if constexpr (AsyncPolicy::enabled) {
+      m_async_waiters.space.retry_all();
+    }
+  }
+
+  // Whether a writer or reader could claim the next index now. The index is
+  // read with an RMW, which, unlike a load, is sure to see the latest claim,
+  // so that a waiter that has just pushed itself does not check a slot that
+  // another thread has already claimed and miss the release of the next one.
+  bool may_acquire_write_index() {
+    return writable_count(m_next_write_index.fetch_add(0u, relaxed), 1u) !=
+           0u;
+  }
+
+  bool may_acquire_read_index() {
+    return readable_count(m_next_read_index.fetch_add(0u, relaxed), 1u) != 0u;
+  }
 
-    return state_str;
+  // Claims a slot for awaiter, or pushes it on waiters to be retried after
+  // the next release. Returns whether the slot was claimed. Once awaiter is
+  // pushed, another thread may resume its coroutine, so it is not touched
+  // again unless this thread takes it back.
+  template <typename Awaiter>
+  bool claim_or_wait(Awaiter& awaiter, AsyncWaiterList& waiters) {
+    while (not awaiter.try_claim()) {
+      waiters.push(awaiter);
+      // If a release came between the failed claim and the push, no other
+      // thread will retry the waiters, so take them back and retry here.
+      if (not Awaiter::may_claim(*this) or
+          not waiters.retry_all_except(awaiter)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Records the time since the count slots starting at read_index, which the
+  // calling thread has just claimed, were published. The stamps were written
+  // before the slots were published, so they are visible to the reader.
+  void record_latencies(Ticket read_index, unsigned int count) {
+    auto now = LatencyPolicy::now();
+    for (auto i = read_index; i != read_index + count; ++i) {
+      auto published_at = slot(i).published_at;
+      m_latency.record(now > published_at ? now - published_at : 0u);
+    }
+  }
+
+  // The values in the count slots starting at index, as at most two ranges of
+  // consecutive slots, since the slots may wrap around the end of the buffer.
+  auto values_in(Ticket index, unsigned int count) {
+    auto to_value = [](Slot& slot) -> T& { return slot.value(); };
+    auto first = static_cast<unsigned int>(index % n_slots());
+    auto first_count = std::min(count, n_slots() - first);
+    auto slots = std::span{m_buffer.data(), n_slots()};
+    return std::pair{
+        slots.subspan(first, first_count) | std::views::transform(to_value),
+        slots.first(count - first_count) | std::views::transform(to_value)};
+  }
+
+  // The atomic that changes when space may have been freed for a writer
+  // waiting to claim write_index, and when data may have been published for a
+  // reader waiting to claim read_index.
+  auto& space_wait_target(Ticket write_index) {
+    if constexpr (per_slot_sequence) {
+      return slot(write_index).sequence;
+    } else {
+      return m_still_reading_index;
+    }
+  }
+
+  auto& data_wait_target(Ticket read_index) {
+    if constexpr (per_slot_sequence) {
+      return slot(read_index).sequence;
+    } else {
+      return m_still_writing_index;
+    }
+  }
+
+  // Waits until test_to_pass returns true, as directed by the wait policy.
+  // wait_target returns the atomic whose modification may make test_to_pass
+  // return true; it is evaluated after a failed test, so it may depend on
+  // state that test_to_pass updates.
+  template <typename Test, typename WaitTarget>
+  void spinlock(Test test_to_pass, WaitTarget wait_target) {
+    for (int trial = 0; not test_to_pass(); ++trial) {
+      if (trial < WaitPolicy::spin_trials) {
+        m_stats.record(BufferCounter::spins);
+        WaitPolicy::spin();
+        continue;
+      }
+      trial = 0;
+      if constexpr (WaitPolicy::parks) {
+        // Observe the target before testing again, so that a change made
+        // after the test failed is caught by wait() rather than lost.
+        auto& target = wait_target();
+        auto observed = target.load(relaxed);
+        if (test_to_pass()) {
+          return;
+        }
+        if (&wait_target() == &target) {
+          m_stats.record(BufferCounter::parks);
+          target.wait(observed, relaxed);
+        }
+      } else {
+        m_stats.record(BufferCounter::back_offs);
+        WaitPolicy::back_off();
+      }
+    }
+  }
+
+  // As spinlock, but gives up once deadline has passed. The clock is only
+  // checked when spinlock would back off. Returns whether test_to_pass
+  // passed.
+  template <typename Test, typename Clock, typename Duration>
+  bool spinlock_until(
+      Test test_to_pass,
+      std::chrono::time_point<Clock, Duration> const& deadline) {
+    for (int trial = 0; not test_to_pass(); ++trial) {
+      if (trial < WaitPolicy::spin_trials) {
+        m_stats.record(BufferCounter::spins);
+        WaitPolicy::spin();
+        continue;
+      }
+      if (Clock::now() >= deadline) {
+        return false;
+      }
+      trial = 0;
+      m_stats.record(BufferCounter::back_offs);
+      WaitPolicy::back_off();
+    }
+    return true;
+  }
+
+  void notify(std::atomic<Ticket>& changed) {
+    if constexpr (WaitPolicy::parks) {
+      changed.notify_all();
+    }
   }
 };
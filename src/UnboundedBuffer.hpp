@@ -0,0 +1,342 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "BufferPolicies.hpp"
+#include "BufferStats.hpp"
+
+// Queue without a capacity, for writers whose bursts would otherwise have to be
+// covered by sizing a ThreadSafeBuffer2 for the worst case. Values are kept in
+// a linked list of segments of N slots each. Writers and readers claim slots in
+// the segments at the tail and head of the list with a fetch_add on the
+// segment's own write or read index, and a writer that claims a slot past the
+// end of the tail segment appends a new one. Any number of threads may write
+// and read, and write_next never waits.
+//
+// Segments are write-once arrays rather than ThreadSafeBuffer2 rings. A ring
+// reuses the slots its readers free, so a writer could go on writing into a
+// segment after a later one has been appended, and its values would then be
+// read out of order, and a reader that found a ring empty could not tell
+// whether to wait on it or move on to the next one. Both would need a way to
+// close a ring to writers, which ThreadSafeBuffer2 does not have.
+//
+// Segments that readers are done with go back to a free list, so once the
+// queue has grown to its working size it allocates nothing. A thread can still
+// be using a segment after other threads have moved past it, so each
+// operation announces the segment it is about to use in a hazard pointer
+// (Michael, 2004), and a segment is only reused once no hazard pointer holds
+// it. The hazard pointers live in max_threads records; an operation takes the
+// record of its thread's this_thread_shard() when it is free, and otherwise
+// looks for another. Popping the free list is guarded in the same way, which
+// keeps a segment from being popped, used and pushed back between another
+// thread's load of the top of the list and its compare-exchange.
+//
+// The only policy taken is a wait policy. Each wait is on a single slot or
+// segment link, so SpinThenPark parks on it.
+template <typename T, int N, BufferPolicy... Policies>
+class UnboundedBuffer {
+  static_assert(N > 0, "Segments must have at least one slot.");
+  static_assert((PolicyOfKind<Policies, wait_policy_kind> and ...),
+                "Only a wait policy may be given.");
+
+  using WaitPolicy =
+      select_policy_t<wait_policy_kind, SpinThenSleep, Policies...>;
+  using Index = std::uint64_t;
+
+ public:
+  auto static constexpr segment_size = N;
+
+  // The number of hazard pointer records. More threads than this can use the
+  // buffer, but only this many at a time; the others wait for a record.
+  auto static constexpr max_threads = 128;
+
+  UnboundedBuffer() : m_head{new Segment}, m_tail{m_head.load()} {}
+
+  UnboundedBuffer(UnboundedBuffer const&) = delete;
+  UnboundedBuffer& operator=(UnboundedBuffer const&) = delete;
+
+  ~UnboundedBuffer() {
+    for (auto segment = m_head.load(); segment != nullptr;) {
+      auto n_written = std::min<Index>(segment->next_write_index, N);
+      for (auto i = segment->next_read_index.load(); i < n_written; ++i) {
+        std::destroy_at(&segment->slots[i].value());
+      }
+      delete std::exchange(segment, segment->next.load());
+    }
+    for (auto list : {m_free.load(), m_retired.load()}) {
+      while (list != nullptr) {
+        delete std::exchange(list, list->next_free.load());
+      }
+    }
+  }
+
+  // The number of segments allocated so far. Stops growing once the buffer
+  // has reached its working size.
+  std::size_t segment_count() const {
+    return m_n_segments.load(std::memory_order_relaxed);
+  }
+
+  void write_next(T t) {
+    auto guard = HazardGuard{*this};
+    // A segment popped to be appended after another writer appended one
+    // first, kept for the next append. Other threads popping the free list
+    // may still hold it in a hazard pointer, so it cannot go straight back.
+    auto spare = static_cast<Segment*>(nullptr);
+    while (true) {
+      auto segment = guard.protect(0, m_tail);
+      auto write_index = segment->next_write_index.fetch_add(1);
+      if (write_index < N) {
+        auto& slot = segment->slots[write_index];
+        std::construct_at(&slot.value(), std::move(t));
+        slot.ready.store(true, std::memory_order_release);
+        notify_waiters<WaitPolicy>(slot.ready);
+        if (spare != nullptr) {
+          guard.clear(1);
+          retire(spare);
+        }
+        return;
+      }
+      // The segment is full, so append a segment if no other writer has, and
+      // move the tail on to it.
+      auto next = segment->next.load(std::memory_order_acquire);
+      if (next == nullptr) {
+        if (spare == nullptr) {
+          spare = pop_free_segment(guard);
+        }
+        if (segment->next.compare_exchange_strong(next, spare)) {
+          next = std::exchange(spare, nullptr);
+          notify_waiters<WaitPolicy>(segment->next);
+        }
+      }
+      m_tail.compare_exchange_strong(segment, next);
+    }
+  }
+
+  template <typename ReadFunc>
+  void read_next(ReadFunc read_func) {
+    auto guard = HazardGuard{*this};
+    while (true) {
+      auto segment = guard.protect(0, m_head);
+      auto read_index = segment->next_read_index.fetch_add(1);
+      if (read_index < N) {
+        // Every slot that is claimed for reading is eventually written.
+        auto& slot = segment->slots[read_index];
+        wait_for(slot.ready, false);
+        consume(slot, read_func);
+        return;
+      }
+      // Every value in the segment has been claimed by a reader, so wait
+      // for the next segment and move on to it.
+      wait_for(segment->next, nullptr);
+      advance_head(guard, segment);
+    }
+  }
+
+  // Reads the next value if it has been written, without waiting. Returns
+  // false if it has not.
+  template <typename ReadFunc>
+  bool try_read_next(ReadFunc read_func) {
+    auto guard = HazardGuard{*this};
+    while (true) {
+      auto segment = guard.protect(0, m_head);
+      auto read_index = segment->next_read_index.load();
+      if (read_index >= N) {
+        if (segment->next.load(std::memory_order_acquire) == nullptr) {
+          return false;
+        }
+        advance_head(guard, segment);
+        continue;
+      }
+      auto& slot = segment->slots[read_index];
+      if (not slot.ready.load(std::memory_order_acquire)) {
+        return false;
+      }
+      if (segment->next_read_index.compare_exchange_weak(read_index,
+                                                         read_index + 1)) {
+        consume(slot, read_func);
+        return true;
+      }
+    }
+  }
+
+ private:
+  struct Slot {
+    std::atomic<bool> ready{};
+    alignas(T) std::byte storage[sizeof(T)]{};
+
+    T& value() { return *std::launder(reinterpret_cast<T*>(storage)); }
+  };
+
+  struct Segment {
+    std::array<Slot, N> slots{};
+    alignas(cache_line_size) std::atomic<Index> next_write_index{};
+    alignas(cache_line_size) std::atomic<Index> next_read_index{};
+    std::atomic<Segment*> next{};
+    // The next segment on the free or retired list.
+    std::atomic<Segment*> next_free{};
+
+    // Makes a segment that readers are done with ready to be appended again.
+    void reset() {
+      for (auto& slot : slots) {
+        slot.ready.store(false, std::memory_order_relaxed);
+      }
+      next_write_index.store(0, std::memory_order_relaxed);
+      next_read_index.store(0, std::memory_order_relaxed);
+      next.store(nullptr, std::memory_order_relaxed);
+    }
+  };
+
+  // The segments one operation is using: the head or tail segment, and the
+  // top of the free list while popping it.
+  struct alignas(cache_line_size) HazardRecord {
+    std::atomic<bool> in_use{};
+    std::array<std::atomic<Segment*>, 2> hazards{};
+  };
+
+  // Holds a hazard record for the duration of one operation.
+  class HazardGuard {
+   public:
+    explicit HazardGuard(UnboundedBuffer& buffer)
+        : m_record{buffer.acquire_record()} {}
+
+    HazardGuard(HazardGuard const&) = delete;
+    HazardGuard& operator=(HazardGuard const&) = delete;
+
+    ~HazardGuard() {
+      clear(0);
+      clear(1);
+      m_record.in_use.store(false, std::memory_order_release);
+    }
+
+    void clear(int i) {
+      m_record.hazards[i].store(nullptr, std::memory_order_release);
+    }
+
+    // Loads source into hazard pointer i and returns it, once the hazard
+    // pointer is known to have been published while source still held it.
+    // Segments are only reused once no list or counter refers to them, so
+    // the segment cannot be reused until the hazard pointer changes.
+    Segment* protect(int i, std::atomic<Segment*>& source) {
+      auto segment = source.load();
+      while (true) {
+        m_record.hazards[i].store(segment);
+        auto current = source.load();
+        if (current == segment) {
+          return segment;
+        }
+        segment = current;
+      }
+    }
+
+   private:
+    HazardRecord& m_record;
+  };
+
+  alignas(cache_line_size) std::atomic<Segment*> m_head;
+  alignas(cache_line_size) std::atomic<Segment*> m_tail;
+  alignas(cache_line_size) std::atomic<Segment*> m_free{};
+  alignas(cache_line_size) std::atomic<Segment*> m_retired{};
+  std::array<HazardRecord, max_threads> m_records{};
+  std::atomic<std::size_t> m_n_segments{1};
+
+  HazardRecord& acquire_record() {
+    for (auto i = this_thread_shard();; ++i) {
+      auto& record = m_records[i % max_threads];
+      if (not record.in_use.load(std::memory_order_relaxed) and
+          not record.in_use.exchange(true, std::memory_order_acquire)) {
+        return record;
+      }
+      if (i % max_threads == max_threads - 1) {
+        WaitPolicy::back_off();
+      }
+    }
+  }
+
+  template <typename ReadFunc>
+  void consume(Slot& slot, ReadFunc& read_func) {
+    read_func(slot.value());
+    std::destroy_at(&slot.value());
+  }
+
+  // Moves the head past segment, whose slots have all been claimed by
+  // readers, and retires it if this thread was the one to move it.
+  void advance_head(HazardGuard& guard, Segment* segment) {
+    auto next = segment->next.load(std::memory_order_acquire);
+    // The tail may still lag behind, and a segment must be unreachable from
+    // both ends before it is retired.
+    auto tail = segment;
+    m_tail.compare_exchange_strong(tail, next);
+    if (m_head.compare_exchange_strong(segment, next)) {
+      // This thread is done with the segment, so its own hazard pointer need
+      // not keep it from being reused.
+      guard.clear(0);
+      retire(segment);
+    }
+  }
+
+  // Hands segment to the free list once no hazard pointer holds it. Segments
+  // that are still held wait on the retired list until the next retirement.
+  void retire(Segment* segment) {
+    segment->next_free.store(m_retired.exchange(nullptr));
+    for (auto retired = segment; retired != nullptr;) {
+      auto next = retired->next_free.load();
+      if (is_hazard(retired)) {
+        push(m_retired, retired);
+      } else {
+        retired->reset();
+        push_free_segment(retired);
+      }
+      retired = next;
+    }
+  }
+
+  bool is_hazard(Segment* segment) {
+    for (auto& record : m_records) {
+      for (auto& hazard : record.hazards) {
+        if (hazard.load() == segment) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  Segment* pop_free_segment(HazardGuard& guard) {
+    while (true) {
+      auto top = guard.protect(1, m_free);
+      if (top == nullptr) {
+        m_n_segments.fetch_add(1, std::memory_order_relaxed);
+        return new Segment;
+      }
+      auto next = top->next_free.load();
+      if (m_free.compare_exchange_weak(top, next)) {
+        return top;
+      }
+    }
+  }
+
+  void push_free_segment(Segment* segment) { push(m_free, segment); }
+
+  static void push(std::atomic<Segment*>& list, Segment* segment) {
+    auto top = list.load(std::memory_order_relaxed);
+    do {
+      segment->next_free.store(top, std::memory_order_relaxed);
+    } while (not list.compare_exchange_weak(top, segment,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed));
+  }
+
+  // Waits until target no longer holds old.
+  template <typename U>
+  void wait_for(std::atomic<U>& target, std::type_identity_t<U> old) {
+    wait_on<WaitPolicy>(target, [old](U observed) { return observed != old; });
+  }
+};
@@ -0,0 +1,272 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ShardedBuffer.hpp"
+#include "SpscBuffer.hpp"
+#include "ThreadSafeBuffer.hpp"
+#include "ThreadSafeBuffer2.hpp"
+
+// Throughput and per-operation latency of the buffers with separate producer
+// and consumer threads, against a bounded std::mutex + std::deque queue.
+//
+// Each iteration moves items_per_iteration values from the producers to the
+// consumers and is timed from the moment all threads are released until the
+// last one finishes. Every write_next and read_next call is timed separately,
+// and the p50/p99/p999 latency counters are taken over all calls in all
+// iterations. A slow consumer spends slow_consumer_work inside each read_next
+// callback, so it holds its slot for that long.
+
+// A bounded queue with the same interface as the buffers.
+template <typename T, int N>
+class MutexDequeBuffer {
+ public:
+  void write_next(T t) {
+    auto lock = std::unique_lock{m_mx};
+    m_not_full.wait(lock, [this]() { return m_queue.size() < N; });
+    m_queue.push_back(std::move(t));
+    lock.unlock();
+    m_not_empty.notify_one();
+  }
+
+  template <typename ReadFunc>
+  void read_next(ReadFunc read_func) {
+    auto lock = std::unique_lock{m_mx};
+    m_not_empty.wait(lock, [this]() { return not m_queue.empty(); });
+    read_func(m_queue.front());
+    m_queue.pop_front();
+    lock.unlock();
+    m_not_full.notify_one();
+  }
+
+ private:
+  std::deque<T> m_queue{};
+  std::mutex m_mx{};
+  std::condition_variable m_not_full{};
+  std::condition_variable m_not_empty{};
+};
+
+template <std::size_t Bytes>
+struct Payload {
+  std::array<std::byte, Bytes> bytes{};
+};
+
+template <typename T, int N>
+using InOrderBuffer = ThreadSafeBuffer2<T, N, InOrderRelease>;
+template <typename T, int N>
+using PerSlotBuffer = ThreadSafeBuffer2<T, N, PerSlotSequence>;
+// One PerSlotBuffer shard per hardware thread.
+template <typename T, int N>
+using ShardedPerSlotBuffer = ShardedBuffer<T, N, PerSlotSequence>;
+
+auto constexpr items_per_iteration = 1 << 14;
+auto constexpr slow_consumer_work = std::chrono::microseconds{1};
+
+// The number of the n_items items handled by thread i of n_threads.
+auto share(std::int64_t i, std::int64_t n_threads,
+           std::int64_t n_items = items_per_iteration) {
+  return n_items / n_threads + (i < n_items % n_threads ? 1 : 0);
+}
+
+void busy_wait(std::chrono::nanoseconds duration) {
+  auto const until = std::chrono::steady_clock::now() + duration;
+  while (std::chrono::steady_clock::now() < until) {
+  }
+}
+
+// Makes room for n more latency samples, so that recording them in the timed
+// region never reallocates. Grows geometrically, as push_back would, since the
+// samples of every iteration are kept.
+void reserve_samples(std::vector<std::int64_t>& samples, std::int64_t n) {
+  auto const needed = samples.size() + static_cast<std::size_t>(n);
+  if (needed > samples.capacity()) {
+    samples.reserve(std::max(needed, 2 * samples.capacity()));
+  }
+}
+
+// Sets the p50, p99 and p999 counters from the latency samples, in ns.
+void set_latency_counters(benchmark::State& state,
+                          std::vector<std::int64_t>& samples) {
+  if (samples.empty()) {
+    return;
+  }
+  for (auto [name, quantile] : {std::pair{"p50_ns", 0.5},
+                                std::pair{"p99_ns", 0.99},
+                                std::pair{"p999_ns", 0.999}}) {
+    auto nth = samples.begin() + static_cast<std::ptrdiff_t>(
+                                     quantile * (samples.size() - 1));
+    std::nth_element(samples.begin(), nth, samples.end());
+    state.counters[name] = static_cast<double>(*nth);
+  }
+}
+
+// Arguments: producers, consumers, and how many of the consumers are slow.
+template <typename Buffer, typename T>
+void BM_ProducersConsumers(benchmark::State& state) {
+  using clock = std::chrono::steady_clock;
+  auto const n_producers = state.range(0);
+  auto const n_consumers = state.range(1);
+  auto const n_slow_consumers = state.range(2);
+  auto buffer = std::make_unique<Buffer>();
+  auto latencies =
+      std::vector<std::vector<std::int64_t>>(n_producers + n_consumers);
+
+  auto timed = [](std::vector<std::int64_t>& samples, auto op) {
+    auto const start = clock::now();
+    op();
+    samples.push_back((clock::now() - start).count());
+  };
+
+  for (auto _ : state) {
+    auto start_line = std::latch{n_producers + n_consumers + 1};
+    auto threads = std::vector<std::jthread>{};
+    for (auto i = 0; i < n_producers; ++i) {
+      threads.emplace_back([&, i]() {
+        auto& samples = latencies[i];
+        reserve_samples(samples, share(i, n_producers));
+        start_line.arrive_and_wait();
+        for (auto j = share(i, n_producers); j > 0; --j) {
+          timed(samples, [&buffer]() { buffer->write_next(T{}); });
+        }
+      });
+    }
+    for (auto i = 0; i < n_consumers; ++i) {
+      threads.emplace_back([&, i]() {
+        auto& samples = latencies[n_producers + i];
+        auto const slow = i < n_slow_consumers;
+        auto read_func = [slow](T const& t) {
+          benchmark::DoNotOptimize(t);
+          if (slow) {
+            busy_wait(slow_consumer_work);
+          }
+        };
+        reserve_samples(samples, share(i, n_consumers));
+        start_line.arrive_and_wait();
+        for (auto j = share(i, n_consumers); j > 0; --j) {
+          timed(samples, [&buffer, &read_func]() {
+            buffer->read_next(read_func);
+          });
+        }
+      });
+    }
+    start_line.arrive_and_wait();
+    auto const start = clock::now();
+    threads.clear();  // joins
+    state.SetIterationTime(
+        std::chrono::duration<double>(clock::now() - start).count());
+  }
+
+  auto const n_items = state.iterations() * items_per_iteration;
+  state.SetItemsProcessed(n_items);
+  state.SetBytesProcessed(n_items * sizeof(T));
+  state.counters["ops"] =
+      benchmark::Counter(2.0 * n_items, benchmark::Counter::kIsRate);
+  auto all_samples = std::vector<std::int64_t>{};
+  for (auto const& samples : latencies) {
+    all_samples.insert(all_samples.end(), samples.begin(), samples.end());
+  }
+  set_latency_counters(state, all_samples);
+}
+
+void producer_consumer_args(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"producers", "consumers", "slow"});
+  for (auto [producers, consumers] :
+       {std::pair{1, 1}, std::pair{1, 4}, std::pair{4, 1}, std::pair{4, 4},
+        std::pair{8, 8}, std::pair{16, 16}}) {
+    b->Args({producers, consumers, 0});
+    if (consumers > 1) {
+      b->Args({producers, consumers, consumers / 2});
+    }
+  }
+  b->UseManualTime();
+}
+
+// Equal numbers of producers and consumers, doubling up to at least 32 and at
+// least twice the number of hardware threads.
+void scaling_args(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"producers", "consumers", "slow"});
+  auto const max_threads =
+      std::max(32u, 2 * std::thread::hardware_concurrency());
+  for (auto n = 1u; n <= max_threads; n *= 2) {
+    b->Args({n, n, 0});
+  }
+  b->UseManualTime();
+}
+
+void single_producer_consumer_args(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"producers", "consumers", "slow"});
+  b->Args({1, 1, 0});
+  b->Args({1, 1, 1});
+  b->UseManualTime();
+}
+
+// Buffer capacity, with int payloads.
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, InOrderBuffer<int, 64>, int)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, PerSlotBuffer<int, 64>, int)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, MutexDequeBuffer<int, 64>, int)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, ThreadSafeBuffer<int, 64>, int)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, InOrderBuffer<int, 1024>, int)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, PerSlotBuffer<int, 1024>, int)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, MutexDequeBuffer<int, 1024>, int)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, ThreadSafeBuffer<int, 1024>, int)
+    ->Apply(producer_consumer_args);
+// ThreadSafeBuffer also takes capacities that are not a power of 2.
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, ThreadSafeBuffer<int, 1000>, int)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, SpscBuffer<int, 1024>, int)
+    ->Apply(single_producer_consumer_args);
+
+// Scaling with the number of threads, with one shared buffer against one
+// shard per hardware thread.
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, PerSlotBuffer<int, 1024>, int)
+    ->Apply(scaling_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, ShardedPerSlotBuffer<int, 1024>, int)
+    ->Apply(scaling_args);
+
+// Payload size, with a capacity of 1024.
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, InOrderBuffer<Payload<64>, 1024>,
+                   Payload<64>)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, PerSlotBuffer<Payload<64>, 1024>,
+                   Payload<64>)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers,
+                   MutexDequeBuffer<Payload<64>, 1024>, Payload<64>)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, InOrderBuffer<Payload<512>, 1024>,
+                   Payload<512>)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, PerSlotBuffer<Payload<512>, 1024>,
+                   Payload<512>)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers,
+                   MutexDequeBuffer<Payload<512>, 1024>, Payload<512>)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, InOrderBuffer<Payload<4096>, 1024>,
+                   Payload<4096>)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers, PerSlotBuffer<Payload<4096>, 1024>,
+                   Payload<4096>)
+    ->Apply(producer_consumer_args);
+BENCHMARK_TEMPLATE(BM_ProducersConsumers,
+                   MutexDequeBuffer<Payload<4096>, 1024>, Payload<4096>)
+    ->Apply(producer_consumer_args);
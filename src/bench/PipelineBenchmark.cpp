@@ -0,0 +1,108 @@
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <latch>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "PipelineBuffer.hpp"
+#include "ThreadSafeBuffer2.hpp"
+
+// A three-stage pipeline (decode, enrich, publish) with one thread per stage
+// and one writer, either as a chain of three ThreadSafeBuffer2 instances,
+// where each stage reads a message out of one buffer and writes it into the
+// next, or as one PipelineBuffer, where each stage works on the message in
+// place. Each stage updates one byte of the message.
+
+auto constexpr pipeline_items_per_iteration = 1 << 14;
+auto constexpr pipeline_capacity = 1024;
+
+template <std::size_t Bytes>
+struct StageMessage {
+  std::array<std::byte, Bytes> bytes{};
+};
+
+template <typename Body>
+void run_stages(benchmark::State& state, int n_threads, Body body) {
+  using clock = std::chrono::steady_clock;
+  for (auto _ : state) {
+    auto start_line = std::latch{n_threads + 1};
+    auto threads = std::vector<std::jthread>{};
+    for (auto i = 0; i < n_threads; ++i) {
+      threads.emplace_back([&, i]() {
+        start_line.arrive_and_wait();
+        body(i);
+      });
+    }
+    start_line.arrive_and_wait();
+    auto const start = clock::now();
+    threads.clear();  // joins
+    state.SetIterationTime(
+        std::chrono::duration<double>(clock::now() - start).count());
+  }
+  state.SetItemsProcessed(state.iterations() * pipeline_items_per_iteration);
+}
+
+template <std::size_t Bytes>
+void BM_ChainedBuffers(benchmark::State& state) {
+  using T = StageMessage<Bytes>;
+  using Buffer = ThreadSafeBuffer2<T, pipeline_capacity, PerSlotSequence>;
+  auto buffers = std::array{std::make_unique<Buffer>(),
+                            std::make_unique<Buffer>(),
+                            std::make_unique<Buffer>()};
+  run_stages(state, 4, [&buffers](int stage) {
+    for (auto i = 0; i < pipeline_items_per_iteration; ++i) {
+      if (stage == 0) {
+        buffers[0]->write_next(T{});
+        continue;
+      }
+      auto t = T{};
+      buffers[stage - 1]->consume_into(t);
+      t.bytes[stage] = std::byte{1};
+      if (stage < 3) {
+        buffers[stage]->write_next(std::move(t));
+      } else {
+        benchmark::DoNotOptimize(t);
+      }
+    }
+  });
+  state.SetBytesProcessed(state.iterations() * pipeline_items_per_iteration *
+                          Bytes);
+}
+
+template <std::size_t Bytes>
+void BM_PipelineBuffer(benchmark::State& state) {
+  using T = StageMessage<Bytes>;
+  auto buffer = std::make_unique<PipelineBuffer<T, pipeline_capacity, 3>>();
+  run_stages(state, 4, [&buffer](int stage) {
+    for (auto i = 0; i < pipeline_items_per_iteration; ++i) {
+      auto work = [stage](T& t) {
+        t.bytes[stage] = std::byte{1};
+        benchmark::DoNotOptimize(t);
+      };
+      switch (stage) {
+        case 0:
+          buffer->write_next(T{});
+          break;
+        case 1:
+          buffer->template process_next<0>(work);
+          break;
+        case 2:
+          buffer->template process_next<1>(work);
+          break;
+        default:
+          buffer->template process_next<2>(work);
+      }
+    }
+  });
+  state.SetBytesProcessed(state.iterations() * pipeline_items_per_iteration *
+                          Bytes);
+}
+
+BENCHMARK_TEMPLATE(BM_ChainedBuffers, 64)->UseManualTime();
+BENCHMARK_TEMPLATE(BM_PipelineBuffer, 64)->UseManualTime();
+BENCHMARK_TEMPLATE(BM_ChainedBuffers, 1024)->UseManualTime();
+BENCHMARK_TEMPLATE(BM_PipelineBuffer, 1024)->UseManualTime();
@@ -0,0 +1,223 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include "SpscBuffer.hpp"
+#include "ThreadSafeBuffer.hpp"
+#include "ThreadSafeBuffer2.hpp"
+
+auto constexpr buffer_size = 1024;
+
+// With more than one benchmark thread, even-numbered threads write and
+// odd-numbered threads read, so thread counts must be 1 or even. A single
+// thread alternates writes and reads. Items processed counts individual
+// write_next and read_next calls.
+template <typename Buffer>
+void BM_WriteRead(benchmark::State& state) {
+  static auto buffer = Buffer{};
+  auto const single_thread = state.threads() == 1;
+  auto const writer = state.thread_index() % 2 == 0;
+
+  for (auto _ : state) {
+    if (single_thread or writer) {
+      buffer.write_next(1);
+    }
+    if (single_thread or not writer) {
+      buffer.read_next([](int a) { benchmark::DoNotOptimize(a); });
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * (single_thread ? 2 : 1));
+}
+
+// As BM_WriteRead, but each thread moves batch_size values per call with
+// write_bulk and read_bulk. Items processed counts individual values.
+template <typename Buffer>
+void BM_WriteReadBulk(benchmark::State& state) {
+  static auto buffer = Buffer{};
+  auto const single_thread = state.threads() == 1;
+  auto const writer = state.thread_index() % 2 == 0;
+  auto values = std::vector<int>(state.range(0), 1);
+
+  for (auto _ : state) {
+    if (single_thread or writer) {
+      buffer.write_bulk(values);
+    }
+    if (single_thread or not writer) {
+      for (auto n_read = 0u; n_read < values.size();) {
+        n_read += buffer.read_bulk(
+            [](auto read_values) {
+              for (int a : read_values) {
+                benchmark::DoNotOptimize(a);
+              }
+            },
+            values.size() - n_read);
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * values.size() *
+                          (single_thread ? 2 : 1));
+}
+
+// As BM_WriteRead, with a Bytes-sized message that the writer either fills in
+// a local copy and passes to write_next, or fills in place in a slot claimed
+// with claim_write.
+template <std::size_t Bytes, bool in_place>
+void BM_WriteReadMessage(benchmark::State& state) {
+  using Message = std::array<std::byte, Bytes>;
+  static auto buffer = ThreadSafeBuffer2<Message, 64, PerSlotSequence>{};
+  auto const single_thread = state.threads() == 1;
+  auto const writer = state.thread_index() % 2 == 0;
+
+  for (auto _ : state) {
+    if (single_thread or writer) {
+      if constexpr (in_place) {
+        auto claim = buffer.claim_write();
+        std::ranges::fill(claim.emplace(), std::byte{1});
+        claim.commit();
+      } else {
+        auto message = Message{};
+        std::ranges::fill(message, std::byte{1});
+        buffer.write_next(message);
+      }
+    }
+    if (single_thread or not writer) {
+      buffer.read_next(
+          [](Message const& m) { benchmark::DoNotOptimize(m.back()); });
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * Bytes *
+                          (single_thread ? 2 : 1));
+}
+
+using InOrderPacked =
+    ThreadSafeBuffer2<int, buffer_size, InOrderRelease, PackedLayout>;
+using InOrderPaddedIndices =
+    ThreadSafeBuffer2<int, buffer_size, InOrderRelease, PaddedIndices>;
+using InOrderPaddedSlots =
+    ThreadSafeBuffer2<int, buffer_size, InOrderRelease, PaddedIndicesAndSlots>;
+using PerSlotPacked =
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, PackedLayout>;
+using PerSlotPaddedIndices =
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, PaddedIndices>;
+using PerSlotPaddedSlots =
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, PaddedIndicesAndSlots>;
+
+BENCHMARK_TEMPLATE(BM_WriteRead, InOrderPacked)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WriteRead, InOrderPaddedIndices)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WriteRead, InOrderPaddedSlots)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WriteRead, PerSlotPacked)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WriteRead, PerSlotPaddedIndices)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WriteRead, PerSlotPaddedSlots)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+BENCHMARK_TEMPLATE(BM_WriteReadBulk, InOrderPacked)
+    ->RangeMultiplier(4)
+    ->Range(1, 256)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WriteReadBulk, PerSlotPacked)
+    ->RangeMultiplier(4)
+    ->Range(1, 256)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+// Reference points for the acquire/release orderings used by default.
+using InOrderSeqCst = ThreadSafeBuffer2<int, buffer_size, InOrderRelease,
+                                        SequentiallyConsistentOrdering>;
+using PerSlotSeqCst = ThreadSafeBuffer2<int, buffer_size, PerSlotSequence,
+                                        SequentiallyConsistentOrdering>;
+
+BENCHMARK_TEMPLATE(BM_WriteRead, InOrderSeqCst)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WriteRead, PerSlotSeqCst)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+// Wait policies, against the default SpinThenSleep.
+using PerSlotBusySpin =
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, BusySpin>;
+using PerSlotSpinThenYield =
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, SpinThenYield>;
+using PerSlotSpinThenPark =
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, SpinThenPark>;
+
+BENCHMARK_TEMPLATE(BM_WriteRead, PerSlotBusySpin)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WriteRead, PerSlotSpinThenYield)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WriteRead, PerSlotSpinThenPark)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+// The cost of counting operations with ShardedStats.
+using PerSlotStats =
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, ShardedStats<>>;
+
+BENCHMARK_TEMPLATE(BM_WriteRead, PerSlotStats)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+// The cost of timing each value's wait with LatencyTracing.
+using PerSlotLatency =
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, LatencyTracing<>>;
+
+BENCHMARK_TEMPLATE(BM_WriteRead, PerSlotLatency)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+#if defined(__x86_64__) or defined(__i386__)
+using PerSlotTscLatency = ThreadSafeBuffer2<int, buffer_size, PerSlotSequence,
+                                            LatencyTracing<TscClock>>;
+
+BENCHMARK_TEMPLATE(BM_WriteRead, PerSlotTscLatency)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+#endif
+
+BENCHMARK_TEMPLATE(BM_WriteReadMessage, 1024, false)
+    ->Threads(1)
+    ->Threads(2)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WriteReadMessage, 1024, true)
+    ->Threads(1)
+    ->Threads(2)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WriteReadMessage, 8192, false)
+    ->Threads(1)
+    ->Threads(2)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WriteReadMessage, 8192, true)
+    ->Threads(1)
+    ->Threads(2)
+    ->UseRealTime();
+
+// ThreadSafeBuffer, at a power-of-2 capacity and at one that is not.
+BENCHMARK_TEMPLATE(BM_WriteRead, ThreadSafeBuffer<int, buffer_size>)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WriteRead, ThreadSafeBuffer<int, 1000>)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+// SpscBuffer supports only one writer and one reader.
+BENCHMARK_TEMPLATE(BM_WriteRead, SpscBuffer<int, buffer_size>)
+    ->Threads(1)
+    ->Threads(2)
+    ->UseRealTime();
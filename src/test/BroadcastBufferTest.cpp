@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "BroadcastBuffer.hpp"
+
+class BroadcastBufferTest : public testing::Test {
+ protected:
+  auto static constexpr buffer_size = 16;
+  auto static constexpr max_subscribers = 4;
+  auto static constexpr n_passes = 1024;
+  auto static constexpr n_values = n_passes * buffer_size;
+
+  BroadcastBuffer<int, buffer_size, max_subscribers> buffer{};
+};
+
+TEST_F(BroadcastBufferTest, EverySubscriberSeesEveryValue) {
+  auto first = buffer.subscribe();
+  auto second = buffer.subscribe();
+  auto first_output = std::vector<int>{};
+  auto second_output = std::vector<int>{};
+
+  for (auto pass = 0; pass < n_passes; ++pass) {
+    for (auto i = 0; i < buffer_size; ++i) {
+      buffer.write_next(pass * buffer_size + i);
+    }
+    for (auto i = 0; i < buffer_size; ++i) {
+      first.read_next([&first_output](int a) { first_output.push_back(a); });
+      second.read_next(
+          [&second_output](int a) { second_output.push_back(a); });
+    }
+  }
+
+  ASSERT_EQ(n_values, first_output.size());
+  ASSERT_EQ(n_values, second_output.size());
+  for (auto i = 0; i < n_values; ++i) {
+    EXPECT_EQ(i, first_output[i]);
+    EXPECT_EQ(i, second_output[i]);
+  }
+}
+
+TEST_F(BroadcastBufferTest, SubscriberStartsAtNextWrite) {
+  buffer.write_next(1);
+  auto subscription = buffer.subscribe();
+  auto output = std::optional<int>{};
+
+  EXPECT_FALSE(subscription.try_read_next([&output](int a) { output = a; }));
+  buffer.write_next(2);
+  EXPECT_TRUE(subscription.try_read_next([&output](int a) { output = a; }));
+  EXPECT_EQ(2, output);
+  EXPECT_FALSE(subscription.try_read_next([&output](int a) { output = a; }));
+}
+
+TEST_F(BroadcastBufferTest, WritesWithoutSubscribersDoNotWait) {
+  for (auto i = 0; i < n_values; ++i) {
+    buffer.write_next(i);
+  }
+
+  auto subscription = buffer.subscribe();
+  auto output = 0;
+  buffer.write_next(n_values);
+  subscription.read_next([&output](int a) { output = a; });
+  EXPECT_EQ(n_values, output);
+}
+
+TEST_F(BroadcastBufferTest, SubscribeThrowsWhenAllSlotsAreTaken) {
+  auto subscriptions = std::vector<decltype(buffer.subscribe())>{};
+  for (auto i = 0; i < max_subscribers; ++i) {
+    subscriptions.push_back(buffer.subscribe());
+  }
+  EXPECT_THROW(buffer.subscribe(), std::length_error);
+
+  subscriptions.pop_back();
+  EXPECT_NO_THROW(buffer.subscribe());
+}
+
+TEST_F(BroadcastBufferTest, WriterWaitsForSlowestSubscriber) {
+  auto fast = buffer.subscribe();
+  auto slow = buffer.subscribe();
+  for (auto i = 0; i < buffer_size; ++i) {
+    buffer.write_next(i);
+    fast.read_next([](int) {});
+  }
+
+  auto written = std::atomic<bool>{};
+  auto writer = std::jthread([this, &written]() {
+    buffer.write_next(buffer_size);
+    written = true;
+  });
+  using namespace std::chrono_literals;
+  std::this_thread::sleep_for(10ms);
+  EXPECT_FALSE(written);
+
+  auto output = -1;
+  slow.read_next([&output](int a) { output = a; });
+  writer.join();
+  EXPECT_TRUE(written);
+  EXPECT_EQ(0, output);
+}
+
+TEST_F(BroadcastBufferTest, UnsubscribedReaderDoesNotHoldBackWriters) {
+  {
+    auto subscription = buffer.subscribe();
+    for (auto i = 0; i < buffer_size; ++i) {
+      buffer.write_next(i);
+    }
+  }
+  for (auto i = 0; i < n_values; ++i) {
+    buffer.write_next(i);
+  }
+}
+
+TEST_F(BroadcastBufferTest, MultipleWritersMultipleSubscribers) {
+  auto constexpr n_writers = 2;
+  auto constexpr n_readers = max_subscribers;
+  auto outputs = std::vector<std::vector<int>>(n_readers);
+  auto readers = std::vector<std::jthread>{};
+  // Subscribed before any writes, so that every reader sees every value.
+  for (auto r = 0; r < n_readers; ++r) {
+    readers.emplace_back([&output = outputs[r],
+                          subscription = buffer.subscribe()]() mutable {
+      for (auto i = 0; i < n_writers * n_values; ++i) {
+        subscription.read_next([&output](int a) { output.push_back(a); });
+      }
+    });
+  }
+  auto writers = std::vector<std::jthread>{};
+  for (auto w = 0; w < n_writers; ++w) {
+    writers.emplace_back([this, w]() {
+      for (auto i = 0; i < n_values; ++i) {
+        buffer.write_next(w * n_values + i);
+      }
+    });
+  }
+  writers.clear();
+  readers.clear();
+
+  for (auto const& output : outputs) {
+    ASSERT_EQ(n_writers * n_values, output.size());
+    // Each writer's values arrive in the order it wrote them.
+    auto next = std::vector<int>(n_writers);
+    for (auto a : output) {
+      auto w = a / n_values;
+      EXPECT_EQ(w * n_values + next[w]++, a);
+    }
+  }
+}
+
+TEST_F(BroadcastBufferTest, SubscribersJoinAndLeaveWhileWriting) {
+  auto constexpr n_readers = max_subscribers + 2;
+  auto constexpr n_rounds = 64;
+  auto constexpr values_per_round = 3 * buffer_size;
+  auto stop = std::atomic<bool>{};
+  auto writer = std::jthread([this, &stop]() {
+    for (auto i = 0; not stop; ++i) {
+      buffer.write_next(i);
+    }
+  });
+
+  auto failures = std::atomic<int>{};
+  auto readers = std::vector<std::jthread>{};
+  for (auto r = 0; r < n_readers; ++r) {
+    readers.emplace_back([this, &failures]() {
+      for (auto round = 0; round < n_rounds; ++round) {
+        auto subscription = std::optional<decltype(buffer.subscribe())>{};
+        while (not subscription) {
+          try {
+            subscription.emplace(buffer.subscribe());
+          } catch (std::length_error const&) {
+            std::this_thread::yield();
+          }
+        }
+        // A subscriber sees consecutive values from wherever it joined.
+        auto previous = -1;
+        for (auto i = 0; i < values_per_round; ++i) {
+          subscription->read_next([&previous, &failures](int a) {
+            if (previous != -1 and a != previous + 1) {
+              ++failures;
+            }
+            previous = a;
+          });
+        }
+      }
+    });
+  }
+  readers.clear();
+  stop = true;
+
+  EXPECT_EQ(0, failures);
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ByteRingBuffer.hpp"
+
+auto constexpr buffer_size = 256;
+using Buffer = ByteRingBuffer<buffer_size>;
+
+// A record of length bytes, each holding seed plus its index.
+std::vector<std::byte> make_record(std::size_t length, int seed) {
+  auto record = std::vector<std::byte>(length);
+  for (auto i = std::size_t{}; i < length; ++i) {
+    record[i] = static_cast<std::byte>(seed + i);
+  }
+  return record;
+}
+
+std::vector<std::byte> read_record(Buffer& buffer) {
+  auto output = std::vector<std::byte>{};
+  buffer.read_next([&output](std::span<std::byte const> record) {
+    output.assign(record.begin(), record.end());
+  });
+  return output;
+}
+
+TEST(ByteRingBufferTest, RecordsOfDifferentLengthsRoundTrip) {
+  auto buffer = Buffer{};
+  for (auto length : {0, 1, 7, 8, 9, 31, 64}) {
+    auto const record = make_record(length, length);
+    buffer.write_next(record);
+    EXPECT_EQ(record, read_record(buffer));
+  }
+}
+
+TEST(ByteRingBufferTest, RecordsWrapAroundWithPadding) {
+  auto buffer = Buffer{};
+  // Lengths that do not divide the buffer size, so that records keep landing
+  // across its end and need padding before them.
+  for (auto i = 0; i < 100; ++i) {
+    auto const length = static_cast<std::size_t>(i * 37 % 100);
+    auto const first = make_record(length, i);
+    auto const second = make_record(Buffer::max_record_size - length, i + 1);
+    buffer.write_next(first);
+    EXPECT_EQ(first, read_record(buffer));
+    buffer.write_next(second);
+    EXPECT_EQ(second, read_record(buffer));
+  }
+}
+
+TEST(ByteRingBufferTest, RecordsAreWrittenInPlace) {
+  auto buffer = Buffer{};
+  {
+    auto claim = buffer.claim_write(5);
+    std::memcpy(claim.bytes().data(), "hello", 5);
+    claim.commit();
+  }
+
+  auto output = std::string{};
+  buffer.read_next([&output](std::span<std::byte const> record) {
+    output.assign(reinterpret_cast<char const*>(record.data()), record.size());
+  });
+  EXPECT_EQ("hello", output);
+}
+
+TEST(ByteRingBufferTest, UncommittedRecordsAreSkipped) {
+  auto buffer = Buffer{};
+  buffer.claim_write(16);
+  auto const record = make_record(16, 1);
+  buffer.write_next(record);
+
+  EXPECT_EQ(record, read_record(buffer));
+  EXPECT_FALSE(buffer.try_read_next([](std::span<std::byte const>) {}));
+}
+
+TEST(ByteRingBufferTest, LaterRecordsWaitForEarlierCommits) {
+  auto buffer = Buffer{};
+  auto claim = buffer.claim_write(4);
+  buffer.write_next(make_record(4, 2));
+  EXPECT_FALSE(buffer.try_read_next([](std::span<std::byte const>) {}));
+
+  std::ranges::fill(claim.bytes(), std::byte{1});
+  claim.commit();
+  EXPECT_EQ(std::vector<std::byte>(4, std::byte{1}), read_record(buffer));
+  EXPECT_EQ(make_record(4, 2), read_record(buffer));
+}
+
+TEST(ByteRingBufferTest, TooLongRecordsThrow) {
+  auto buffer = Buffer{};
+  EXPECT_THROW(buffer.claim_write(Buffer::max_record_size + 1),
+               std::length_error);
+  auto const record = make_record(Buffer::max_record_size + 1, 0);
+  EXPECT_THROW(buffer.try_write_next(record), std::length_error);
+}
+
+TEST(ByteRingBufferTest, TryWriteFailsWhenFull) {
+  auto buffer = Buffer{};
+  auto const record = make_record(24, 0);
+  auto n_written = 0;
+  while (buffer.try_write_next(record)) {
+    ++n_written;
+  }
+  // Each record takes up 24 bytes, so the eleventh would also need 16 bytes
+  // of padding before the end of the buffer.
+  EXPECT_EQ(buffer_size / 24, n_written);
+
+  EXPECT_EQ(record, read_record(buffer));
+  EXPECT_TRUE(buffer.try_write_next(record));
+}
+
+TEST(ByteRingBufferTest, TryReadFailsWhenEmpty) {
+  auto buffer = Buffer{};
+  EXPECT_FALSE(buffer.try_read_next([](std::span<std::byte const>) {}));
+  buffer.write_next(make_record(3, 0));
+  EXPECT_TRUE(buffer.try_read_next([](std::span<std::byte const>) {}));
+  EXPECT_FALSE(buffer.try_read_next([](std::span<std::byte const>) {}));
+}
+
+TEST(ByteRingBufferTest, ConcurrentWritersAndReadersKeepRecordsWhole) {
+  auto constexpr n_writers = 4;
+  auto constexpr n_readers = 4;
+  auto constexpr n_records = 2000;
+  auto buffer = ByteRingBuffer<1024, SpinThenYield>{};
+
+  auto writers = std::vector<std::jthread>{};
+  for (auto w = 0; w < n_writers; ++w) {
+    writers.emplace_back([&buffer, w]() {
+      for (auto i = 0; i < n_records; ++i) {
+        // The first byte holds the writer, and the rest repeat the length.
+        auto const length = static_cast<std::size_t>(1 + (i * 13 + w) % 200);
+        auto claim = buffer.claim_write(length);
+        auto bytes = claim.bytes();
+        std::ranges::fill(bytes, static_cast<std::byte>(length));
+        bytes[0] = static_cast<std::byte>(w);
+        claim.commit();
+      }
+    });
+  }
+
+  auto mutex = std::mutex{};
+  auto lengths = std::vector<std::vector<std::size_t>>(n_writers);
+  auto n_corrupt = 0;
+  auto readers = std::vector<std::jthread>{};
+  for (auto r = 0; r < n_readers; ++r) {
+    readers.emplace_back([&]() {
+      for (auto i = 0; i < n_writers * n_records / n_readers; ++i) {
+        buffer.read_next([&](std::span<std::byte const> record) {
+          auto const length = static_cast<std::byte>(record.size());
+          auto const whole = std::all_of(
+              record.begin() + 1, record.end(),
+              [length](std::byte b) { return b == length; });
+          auto lock = std::scoped_lock{mutex};
+          n_corrupt += not whole;
+          lengths[static_cast<int>(record[0])].push_back(record.size());
+        });
+      }
+    });
+  }
+  writers.clear();
+  readers.clear();
+
+  EXPECT_EQ(0, n_corrupt);
+  for (auto w = 0; w < n_writers; ++w) {
+    auto expected = std::vector<std::size_t>{};
+    for (auto i = 0; i < n_records; ++i) {
+      expected.push_back(static_cast<std::size_t>(1 + (i * 13 + w) % 200));
+    }
+    std::ranges::sort(expected);
+    std::ranges::sort(lengths[w]);
+    EXPECT_EQ(expected, lengths[w]);
+  }
+}
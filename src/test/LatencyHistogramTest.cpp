@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <limits>
+
+#include "LatencyHistogram.hpp"
+
+TEST(LatencyHistogramTest, BucketsAreContiguousAndContainTheirValues) {
+  EXPECT_EQ(0u, LatencyHistogram::lowest_in(0));
+  for (auto i = 0u; i + 1 < LatencyHistogram::n_buckets; ++i) {
+    EXPECT_EQ(LatencyHistogram::highest_in(i) + 1,
+              LatencyHistogram::lowest_in(i + 1));
+    EXPECT_EQ(i, LatencyHistogram::bucket_of(LatencyHistogram::lowest_in(i)));
+    EXPECT_EQ(i, LatencyHistogram::bucket_of(LatencyHistogram::highest_in(i)));
+  }
+  EXPECT_EQ(LatencyHistogram::n_buckets - 1,
+            LatencyHistogram::bucket_of(
+                std::numeric_limits<std::uint64_t>::max()));
+}
+
+TEST(LatencyHistogramTest, BucketsAreWithinOneSixteenthOfTheirValues) {
+  for (auto i = LatencyHistogram::n_sub_buckets;
+       i < LatencyHistogram::n_buckets; ++i) {
+    auto lowest = LatencyHistogram::lowest_in(i);
+    auto width = LatencyHistogram::highest_in(i) - lowest + 1;
+    EXPECT_LE(width * LatencyHistogram::n_sub_buckets, lowest);
+  }
+}
+
+TEST(LatencyHistogramTest, Percentiles) {
+  auto histogram = LatencyHistogram{};
+  EXPECT_EQ(0u, histogram.percentile(99.0));
+
+  // 1..1000 ns, once each.
+  for (auto ns = 1u; ns <= 1000u; ++ns) {
+    histogram.record(ns);
+  }
+  EXPECT_EQ(1000u, histogram.count());
+  auto expect_near = [](std::uint64_t expected, std::uint64_t actual) {
+    EXPECT_LE(expected, actual);
+    EXPECT_GE(expected + expected / LatencyHistogram::n_sub_buckets, actual);
+  };
+  expect_near(500u, histogram.percentile(50.0));
+  expect_near(990u, histogram.percentile(99.0));
+  expect_near(1000u, histogram.percentile(100.0));
+  EXPECT_EQ(1u, histogram.percentile(0.0));
+}
+
+TEST(LatencyHistogramTest, MergedHistogramsAddUp) {
+  auto a = LatencyHistogram{};
+  auto b = LatencyHistogram{};
+  a.record(10u, 3);
+  b.record(10u);
+  b.record(1'000'000u);
+
+  a += b;
+  EXPECT_EQ(5u, a.count());
+  EXPECT_EQ(4u, a.count_in(LatencyHistogram::bucket_of(10u)));
+  EXPECT_EQ(10u, a.percentile(80.0));
+  EXPECT_LE(1'000'000u, a.percentile(100.0));
+}
@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "PipelineBuffer.hpp"
+
+auto constexpr buffer_size = 16;
+auto constexpr n_stages = 3;
+
+// Records which stages have processed it, so that each stage can check that
+// the stages before it are done.
+struct Message {
+  int value{};
+  int stages_done{};
+};
+
+template <typename Buffer>
+class PipelineBufferTest : public testing::Test {
+ protected:
+  auto static constexpr n_passes = 1024;
+  auto static constexpr n_values = n_passes * buffer_size;
+
+  Buffer buffer{};
+  std::vector<int> output{};
+
+  // Decode, enrich, publish.
+  template <int Stage>
+  void process_one() {
+    buffer.template process_next<Stage>([this](Message& message) {
+      EXPECT_EQ(Stage, message.stages_done);
+      ++message.stages_done;
+      if constexpr (Stage == 0) {
+        message.value *= 2;
+      } else if constexpr (Stage == 1) {
+        message.value += 1;
+      } else {
+        output.push_back(message.value);
+      }
+    });
+  }
+};
+
+using BufferTypes = testing::Types<
+    PipelineBuffer<Message, buffer_size, n_stages>,
+    PipelineBuffer<Message, buffer_size, n_stages, SpinThenYield>,
+    PipelineBuffer<Message, buffer_size, n_stages, SpinThenPark>>;
+TYPED_TEST_SUITE(PipelineBufferTest, BufferTypes);
+
+TYPED_TEST(PipelineBufferTest, SingleThreadAlternateWriteProcess) {
+  for (auto i = 0; i < this->n_values; ++i) {
+    this->buffer.write_next({i});
+    this->template process_one<0>();
+    this->template process_one<1>();
+    this->template process_one<2>();
+  }
+
+  ASSERT_EQ(this->n_values, this->output.size());
+  for (auto i = 0; i < this->n_values; ++i) {
+    EXPECT_EQ(2 * i + 1, this->output[i]);
+  }
+}
+
+TYPED_TEST(PipelineBufferTest, SingleThreadStageByStage) {
+  for (auto pass = 0; pass < this->n_passes; ++pass) {
+    for (auto i = 0; i < buffer_size; ++i) {
+      this->buffer.write_next({pass * buffer_size + i});
+    }
+    for (auto i = 0; i < buffer_size; ++i) {
+      this->template process_one<0>();
+    }
+    for (auto i = 0; i < buffer_size; ++i) {
+      this->template process_one<1>();
+    }
+    for (auto i = 0; i < buffer_size; ++i) {
+      this->template process_one<2>();
+    }
+  }
+
+  ASSERT_EQ(this->n_values, this->output.size());
+  for (auto i = 0; i < this->n_values; ++i) {
+    EXPECT_EQ(2 * i + 1, this->output[i]);
+  }
+}
+
+TYPED_TEST(PipelineBufferTest, OneThreadPerStage) {
+  auto writer = std::jthread([this]() {
+    for (auto i = 0; i < this->n_values; ++i) {
+      this->buffer.write_next({i});
+    }
+  });
+  auto decoder = std::jthread([this]() {
+    for (auto i = 0; i < this->n_values; ++i) {
+      this->template process_one<0>();
+    }
+  });
+  auto enricher = std::jthread([this]() {
+    for (auto i = 0; i < this->n_values; ++i) {
+      this->template process_one<1>();
+    }
+  });
+  for (auto i = 0; i < this->n_values; ++i) {
+    this->template process_one<2>();
+  }
+
+  ASSERT_EQ(this->n_values, this->output.size());
+  for (auto i = 0; i < this->n_values; ++i) {
+    EXPECT_EQ(2 * i + 1, this->output[i]);
+  }
+}
+
+TYPED_TEST(PipelineBufferTest, SeveralThreadsPerStage) {
+  auto constexpr n_threads = 4;
+  auto constexpr n_ops_per_thread = this->n_values / n_threads;
+  auto threads = std::vector<std::jthread>{};
+  for (auto t = 0; t < n_threads; ++t) {
+    threads.emplace_back([this, t]() {
+      for (auto i = 0; i < n_ops_per_thread; ++i) {
+        this->buffer.write_next({t * n_ops_per_thread + i});
+      }
+    });
+    threads.emplace_back([this]() {
+      for (auto i = 0; i < n_ops_per_thread; ++i) {
+        this->template process_one<0>();
+      }
+    });
+    threads.emplace_back([this]() {
+      for (auto i = 0; i < n_ops_per_thread; ++i) {
+        this->template process_one<1>();
+      }
+    });
+  }
+  // The last stage stays on one thread, which owns the output.
+  for (auto i = 0; i < this->n_values; ++i) {
+    this->template process_one<2>();
+  }
+  threads.clear();
+
+  ASSERT_EQ(this->n_values, this->output.size());
+  std::ranges::sort(this->output);
+  for (auto i = 0; i < this->n_values; ++i) {
+    EXPECT_EQ(2 * i + 1, this->output[i]);
+  }
+}
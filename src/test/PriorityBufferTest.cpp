@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "PriorityBuffer.hpp"
+
+auto constexpr lane_size = 64;
+auto constexpr n_lanes = 3;
+
+// A value tagged with the lane it was written to.
+struct LaneValue {
+  int lane{};
+  int value{};
+};
+
+TEST(PriorityBufferTest, StrictPriorityReadsUrgentLanesFirst) {
+  auto buffer = PriorityBuffer<LaneValue, lane_size, n_lanes>{};
+  for (auto i = 0; i < lane_size; ++i) {
+    for (auto lane = n_lanes - 1; lane >= 0; --lane) {
+      buffer.write_next(lane, {lane, i});
+    }
+  }
+
+  for (auto lane = 0; lane < n_lanes; ++lane) {
+    for (auto i = 0; i < lane_size; ++i) {
+      auto output = LaneValue{};
+      buffer.read_next([&output](LaneValue v) { output = v; });
+      EXPECT_EQ(lane, output.lane);
+      EXPECT_EQ(i, output.value);
+    }
+  }
+  EXPECT_FALSE(buffer.try_read_next([](LaneValue) {}));
+}
+
+TEST(PriorityBufferTest, UrgentValueOvertakesBulkValues) {
+  auto buffer = PriorityBuffer<LaneValue, lane_size, n_lanes>{};
+  for (auto i = 0; i < lane_size / 2; ++i) {
+    buffer.write_next(2, {2, i});
+  }
+  buffer.write_next(0, {0, 0});
+
+  auto output = LaneValue{};
+  buffer.read_next([&output](LaneValue v) { output = v; });
+  EXPECT_EQ(0, output.lane);
+}
+
+TEST(PriorityBufferTest, WeightedRoundRobinSharesReadsByWeight) {
+  auto buffer = PriorityBuffer<LaneValue, lane_size, n_lanes,
+                               WeightedRoundRobin<3, 2, 1>>{};
+  auto constexpr n_cycles = 10;
+  for (auto i = 0; i < lane_size; ++i) {
+    for (auto lane = 0; lane < n_lanes; ++lane) {
+      buffer.write_next(lane, {lane, i});
+    }
+  }
+
+  auto reads = std::array<int, n_lanes>{};
+  for (auto i = 0; i < n_cycles * 6; ++i) {
+    buffer.read_next([&reads](LaneValue v) { ++reads[v.lane]; });
+  }
+  EXPECT_EQ(3 * n_cycles, reads[0]);
+  EXPECT_EQ(2 * n_cycles, reads[1]);
+  EXPECT_EQ(1 * n_cycles, reads[2]);
+}
+
+TEST(PriorityBufferTest, WeightedRoundRobinSkipsEmptyLanes) {
+  auto buffer = PriorityBuffer<LaneValue, lane_size, n_lanes,
+                               WeightedRoundRobin<3, 2, 1>>{};
+  for (auto i = 0; i < lane_size; ++i) {
+    buffer.write_next(2, {2, i});
+  }
+
+  for (auto i = 0; i < lane_size; ++i) {
+    auto output = LaneValue{};
+    EXPECT_TRUE(buffer.try_read_next([&output](LaneValue v) { output = v; }));
+    EXPECT_EQ(i, output.value);
+  }
+  EXPECT_FALSE(buffer.try_read_next([](LaneValue) {}));
+}
+
+TEST(PriorityBufferTest, TryWriteFailsWhenLaneIsFull) {
+  auto buffer = PriorityBuffer<LaneValue, lane_size, n_lanes>{};
+  for (auto i = 0; i < lane_size; ++i) {
+    EXPECT_TRUE(buffer.try_write_next(1, LaneValue{1, i}));
+  }
+  EXPECT_FALSE(buffer.try_write_next(1, LaneValue{1, lane_size}));
+  EXPECT_TRUE(buffer.try_write_next(0, LaneValue{0, 0}));
+  EXPECT_EQ(lane_size, buffer.size_approx(1));
+}
+
+template <typename Buffer>
+class PriorityBufferThreadsTest : public testing::Test {
+ protected:
+  auto static constexpr n_threads = 4;
+  auto static constexpr n_ops_per_thread = 4096;
+
+  Buffer buffer{};
+};
+
+using BufferTypes = testing::Types<
+    PriorityBuffer<LaneValue, lane_size, n_lanes>,
+    PriorityBuffer<LaneValue, lane_size, n_lanes, WeightedRoundRobin<4, 2, 1>,
+                   PerSlotSequence>,
+    PriorityBuffer<LaneValue, lane_size, n_lanes, StrictPriority,
+                   SpinThenPark>>;
+TYPED_TEST_SUITE(PriorityBufferThreadsTest, BufferTypes);
+
+TYPED_TEST(PriorityBufferThreadsTest, MultipleWritersMultipleReaders) {
+  auto constexpr n_ops_per_thread = this->n_ops_per_thread;
+  auto output = std::vector<int>{};
+  auto output_mx = std::mutex{};
+
+  auto threads = std::vector<std::jthread>{};
+  for (auto t = 0; t < this->n_threads; ++t) {
+    threads.emplace_back([this, t]() {
+      for (auto i = 0; i < n_ops_per_thread; ++i) {
+        auto lane = i % n_lanes;
+        this->buffer.write_next(lane, {lane, t * n_ops_per_thread + i});
+      }
+    });
+    threads.emplace_back([this, &output, &output_mx]() {
+      auto read = std::vector<int>{};
+      for (auto i = 0; i < n_ops_per_thread; ++i) {
+        this->buffer.read_next([&read](LaneValue v) {
+          EXPECT_EQ(v.value % n_ops_per_thread % n_lanes, v.lane);
+          read.push_back(v.value);
+        });
+      }
+      auto lock = std::scoped_lock{output_mx};
+      output.insert(output.end(), read.begin(), read.end());
+    });
+  }
+  threads.clear();
+
+  auto const n_values = this->n_threads * n_ops_per_thread;
+  ASSERT_EQ(n_values, output.size());
+  std::ranges::sort(output);
+  for (auto i = 0; i < n_values; ++i) {
+    EXPECT_EQ(i, output[i]);
+  }
+}
@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ShardedBuffer.hpp"
+
+class ShardedBufferTest : public testing::Test {
+ protected:
+  auto static constexpr shard_size = 16;
+  auto static constexpr n_shards = 4;
+  auto static constexpr n_passes = 1024;
+  auto static constexpr n_values = n_passes * shard_size;
+
+  ShardedBuffer<int, shard_size, PerSlotSequence> buffer{n_shards};
+};
+
+TEST_F(ShardedBufferTest, DefaultsToOneShardPerHardwareThread) {
+  auto default_buffer = ShardedBuffer<int, shard_size>{};
+  EXPECT_EQ(std::max(1u, std::thread::hardware_concurrency()),
+            default_buffer.n_shards());
+  EXPECT_EQ(n_shards, buffer.n_shards());
+}
+
+TEST_F(ShardedBufferTest, SingleThreadReadsInWriteOrder) {
+  auto output = std::vector<int>{};
+
+  for (auto pass = 0; pass < n_passes; ++pass) {
+    for (auto i = 0; i < shard_size; ++i) {
+      buffer.write_next(pass * shard_size + i);
+    }
+    EXPECT_EQ(shard_size, buffer.size_approx());
+    for (auto i = 0; i < shard_size; ++i) {
+      buffer.read_next([&output](int a) { output.push_back(a); });
+    }
+  }
+
+  ASSERT_EQ(n_values, output.size());
+  for (auto i = 0; i < n_values; ++i) {
+    EXPECT_EQ(i, output[i]);
+  }
+}
+
+TEST_F(ShardedBufferTest, TryWriteFailsWhenHomeShardIsFull) {
+  for (auto i = 0; i < shard_size; ++i) {
+    EXPECT_TRUE(buffer.try_write_next(i));
+  }
+  EXPECT_FALSE(buffer.try_write_next(shard_size));
+
+  auto output = -1;
+  EXPECT_TRUE(buffer.try_read_next([&output](int a) { output = a; }));
+  EXPECT_EQ(0, output);
+  EXPECT_TRUE(buffer.try_write_next(shard_size));
+}
+
+TEST_F(ShardedBufferTest, TryReadFailsWhenEveryShardIsEmpty) {
+  EXPECT_FALSE(buffer.try_read_next([](int) {}));
+}
+
+TEST_F(ShardedBufferTest, ReaderStealsFromWriterShard) {
+  // The writer is pinned to a shard other than the reader's home shard, so
+  // every value the reader gets is stolen from that shard.
+  auto const reader_shard = buffer.home_shard_index();
+  auto const writer_shard = (reader_shard + 1) % n_shards;
+  ASSERT_NE(reader_shard, writer_shard);
+  auto writer = std::jthread([this, writer_shard]() {
+    for (auto i = 0; i < n_values; ++i) {
+      buffer.write_next_to(writer_shard, i);
+    }
+  });
+  auto output = std::vector<int>{};
+  for (auto i = 0; i < n_values; ++i) {
+    buffer.read_next([&output](int a) { output.push_back(a); });
+  }
+
+  ASSERT_EQ(n_values, output.size());
+  for (auto i = 0; i < n_values; ++i) {
+    EXPECT_EQ(i, output[i]);
+  }
+}
+
+TEST_F(ShardedBufferTest, MultipleWritersMultipleReaders) {
+  auto constexpr n_threads = 2 * n_shards;
+  auto constexpr n_ops_per_thread = n_values / n_threads;
+  auto output = std::vector<int>{};
+  auto output_mx = std::mutex{};
+  auto out_of_order = std::atomic<int>{};
+
+  auto threads = std::vector<std::jthread>{};
+  for (auto t = 0; t < n_threads; ++t) {
+    threads.emplace_back([this, t]() {
+      for (auto i = 0; i < n_ops_per_thread; ++i) {
+        buffer.write_next(t * n_ops_per_thread + i);
+      }
+    });
+    threads.emplace_back([&]() {
+      // Each reader sees each writer's values in the order they were
+      // written, though it may not see all of them.
+      auto last_read = std::vector<int>(n_threads, -1);
+      auto read = std::vector<int>{};
+      for (auto i = 0; i < n_ops_per_thread; ++i) {
+        buffer.read_next([&](int a) {
+          auto& last = last_read[a / n_ops_per_thread];
+          if (a <= last) {
+            ++out_of_order;
+          }
+          last = a;
+          read.push_back(a);
+        });
+      }
+      auto lock = std::scoped_lock{output_mx};
+      output.insert(output.end(), read.begin(), read.end());
+    });
+  }
+  threads.clear();
+
+  EXPECT_EQ(0, out_of_order);
+  ASSERT_EQ(n_values, output.size());
+  std::ranges::sort(output);
+  for (auto i = 0; i < n_values; ++i) {
+    EXPECT_EQ(i, output[i]);
+  }
+}
@@ -0,0 +1,196 @@
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "SharedMemoryBuffer.hpp"
+
+auto constexpr buffer_size = 16;
+
+struct Message {
+  int sequence_number;
+  double price;
+};
+
+class SharedMemoryBufferTest : public testing::Test {
+ protected:
+  using Buffer = SharedMemoryBuffer<Message, buffer_size>;
+
+  auto static constexpr n_passes = 1024;
+  auto static constexpr n_values = n_passes * buffer_size;
+
+  // Unique to the process and test, so that test runs do not collide.
+  std::string const name =
+      "/SharedMemoryBufferTest_" + std::to_string(getpid()) + "_" +
+      testing::UnitTest::GetInstance()->current_test_info()->name();
+
+  void TearDown() override { Buffer::remove(name); }
+};
+
+TEST_F(SharedMemoryBufferTest, WriteThroughOneMappingReadThroughAnother) {
+  auto writer = Buffer::create(name);
+  auto reader = Buffer::open(name);
+  auto output = std::vector<int>{};
+
+  for (auto pass = 0; pass < n_passes; ++pass) {
+    for (auto i = 0; i < buffer_size; ++i) {
+      writer.write_next({pass * buffer_size + i, 1.5});
+    }
+    for (auto i = 0; i < buffer_size; ++i) {
+      reader.read_next([&output](Message const& m) {
+        output.push_back(m.sequence_number);
+        EXPECT_EQ(1.5, m.price);
+      });
+    }
+  }
+
+  ASSERT_EQ(n_values, output.size());
+  for (auto i = 0; i < n_values; ++i) {
+    EXPECT_EQ(i, output[i]);
+  }
+}
+
+TEST_F(SharedMemoryBufferTest, TryWriteAndTryReadDoNotWait) {
+  auto buffer = Buffer::create(name);
+  EXPECT_FALSE(buffer.try_read_next([](Message const&) {}));
+  for (auto i = 0; i < buffer_size; ++i) {
+    EXPECT_TRUE(buffer.try_write_next({i, 0.0}));
+  }
+  EXPECT_FALSE(buffer.try_write_next({buffer_size, 0.0}));
+
+  auto output = -1;
+  EXPECT_TRUE(buffer.try_read_next(
+      [&output](Message const& m) { output = m.sequence_number; }));
+  EXPECT_EQ(0, output);
+}
+
+TEST_F(SharedMemoryBufferTest, CreateFailsIfNameExists) {
+  auto buffer = Buffer::create(name);
+  EXPECT_THROW(Buffer::create(name), std::system_error);
+}
+
+TEST_F(SharedMemoryBufferTest, OpenFailsIfNameDoesNotExist) {
+  EXPECT_THROW(Buffer::open(name), std::system_error);
+}
+
+TEST_F(SharedMemoryBufferTest, OpenChecksLayout) {
+  auto buffer = Buffer::create(name);
+  EXPECT_THROW((SharedMemoryBuffer<Message, 2 * buffer_size>::open(name)),
+               std::runtime_error);
+  EXPECT_THROW((SharedMemoryBuffer<std::array<int, 4>, buffer_size>::open(
+                   name)),
+               std::runtime_error);
+}
+
+TEST_F(SharedMemoryBufferTest, WriterAndReaderInSeparateProcesses) {
+  auto buffer = Buffer::create(name);
+
+  auto child = fork();
+  ASSERT_NE(-1, child);
+  if (child == 0) {
+    // The child maps the buffer afresh, as an unrelated process would.
+    auto writer = Buffer::open(name);
+    for (auto i = 0; i < n_values; ++i) {
+      writer.write_next({i, 0.0});
+    }
+    _exit(0);
+  }
+
+  // More values than slots, so each side sleeps on the other.
+  auto output = std::vector<int>{};
+  for (auto i = 0; i < n_values; ++i) {
+    buffer.read_next(
+        [&output](Message const& m) { output.push_back(m.sequence_number); });
+  }
+  auto status = 0;
+  waitpid(child, &status, 0);
+  EXPECT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(0, WEXITSTATUS(status));
+
+  ASSERT_EQ(n_values, output.size());
+  for (auto i = 0; i < n_values; ++i) {
+    EXPECT_EQ(i, output[i]);
+  }
+}
+
+TEST_F(SharedMemoryBufferTest, MultipleWritersMultipleReaders) {
+  auto constexpr n_threads = 4;
+  auto constexpr n_ops_per_thread = n_values / n_threads;
+  auto buffer = Buffer::create(name);
+  auto output = std::vector<int>{};
+  auto output_mx = std::mutex{};
+
+  auto threads = std::vector<std::jthread>{};
+  for (auto t = 0; t < n_threads; ++t) {
+    threads.emplace_back([&buffer, t]() {
+      for (auto i = 0; i < n_ops_per_thread; ++i) {
+        buffer.write_next({t * n_ops_per_thread + i, 0.0});
+      }
+    });
+    threads.emplace_back([this, &output, &output_mx]() {
+      // Each reader maps the buffer separately.
+      auto reader = Buffer::open(name);
+      auto read = std::vector<int>{};
+      for (auto i = 0; i < n_ops_per_thread; ++i) {
+        reader.read_next(
+            [&read](Message const& m) { read.push_back(m.sequence_number); });
+      }
+      auto lock = std::scoped_lock{output_mx};
+      output.insert(output.end(), read.begin(), read.end());
+    });
+  }
+  threads.clear();
+
+  ASSERT_EQ(n_values, output.size());
+  std::ranges::sort(output);
+  for (auto i = 0; i < n_values; ++i) {
+    EXPECT_EQ(i, output[i]);
+  }
+}
+
+// The buffer starts half full, and no more values are written or read than
+// half the capacity, so every try must succeed: a reader never reaches a
+// value that is not yet written, and a writer never reaches a value that is
+// not yet read. A try whose index goes stale while another thread claims
+// past it must retry rather than report the buffer full or empty. The
+// capacity is large so that there are enough tries for that to happen.
+TEST_F(SharedMemoryBufferTest, TriesDoNotFailWhileBufferIsNeitherFullNorEmpty) {
+  auto constexpr capacity = 1 << 20;
+  auto constexpr n_threads = 2;
+  auto constexpr n_ops_per_thread = capacity / 2 / n_threads;
+  using LargeBuffer = SharedMemoryBuffer<Message, capacity>;
+  auto buffer = LargeBuffer::create(name);
+  for (auto i = 0; i < capacity / 2; ++i) {
+    buffer.write_next({i, 0.0});
+  }
+
+  auto n_failed_writes = std::atomic<int>{};
+  auto n_failed_reads = std::atomic<int>{};
+  auto threads = std::vector<std::jthread>{};
+  for (auto t = 0; t < n_threads; ++t) {
+    threads.emplace_back([&buffer, &n_failed_writes]() {
+      for (auto i = 0; i < n_ops_per_thread; ++i) {
+        n_failed_writes += not buffer.try_write_next({i, 0.0});
+      }
+    });
+    threads.emplace_back([this, &n_failed_reads]() {
+      auto reader = LargeBuffer::open(name);
+      for (auto i = 0; i < n_ops_per_thread; ++i) {
+        n_failed_reads += not reader.try_read_next([](Message const&) {});
+      }
+    });
+  }
+  threads.clear();
+
+  EXPECT_EQ(0, n_failed_writes.load());
+  EXPECT_EQ(0, n_failed_reads.load());
+}
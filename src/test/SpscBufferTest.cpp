@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include "SpscBuffer.hpp"
+
+class SpscBufferTest : public testing::Test {
+ protected:
+  auto static constexpr buffer_size = 16;
+  auto static constexpr n_passes = 1024;
+  auto static constexpr n_values = n_passes * buffer_size;
+
+  SpscBuffer<int, buffer_size> buffer{};
+};
+
+TEST_F(SpscBufferTest, SingleThreadAlternateWriteRead) {
+  auto output_vector = std::vector<int>{};
+
+  for (auto i = 0; i < n_values; ++i) {
+    buffer.write_next(i);
+    buffer.read_next([&output_vector](int a) { output_vector.push_back(a); });
+  }
+
+  EXPECT_EQ(n_values, output_vector.size());
+  for (auto i = 0; i < n_values; ++i) {
+    EXPECT_EQ(i, output_vector[i]);
+  }
+}
+
+TEST_F(SpscBufferTest, SingleThreadFillThenDrain) {
+  auto output_vector = std::vector<int>{};
+
+  for (auto pass = 0; pass < n_passes; ++pass) {
+    for (auto i = 0; i < buffer_size; ++i) {
+      buffer.write_next(pass * buffer_size + i);
+    }
+    for (auto i = 0; i < buffer_size; ++i) {
+      buffer.read_next([&output_vector](int a) { output_vector.push_back(a); });
+    }
+  }
+
+  EXPECT_EQ(n_values, output_vector.size());
+  for (auto i = 0; i < n_values; ++i) {
+    EXPECT_EQ(i, output_vector[i]);
+  }
+}
+
+TEST_F(SpscBufferTest, SingleWriterSingleReader) {
+  auto output_vector = std::vector<int>{};
+
+  auto writer = std::jthread([this]() {
+    for (auto i = 0; i < n_values; ++i) {
+      buffer.write_next(i);
+    }
+  });
+  for (auto i = 0; i < n_values; ++i) {
+    buffer.read_next([&output_vector](int a) { output_vector.push_back(a); });
+  }
+
+  EXPECT_EQ(n_values, output_vector.size());
+  for (auto i = 0; i < n_values; ++i) {
+    EXPECT_EQ(i, output_vector[i]);
+  }
+}
+
+TEST_F(SpscBufferTest, SingleWriterSingleReaderSlowWrites) {
+  auto output_vector = std::vector<int>{};
+
+  auto writer = std::jthread([this]() {
+    for (auto i = 0; i < n_values; ++i) {
+      using namespace std::chrono_literals;
+      std::this_thread::sleep_for(1us);
+      buffer.write_next(i);
+    }
+  });
+  for (auto i = 0; i < n_values; ++i) {
+    buffer.read_next([&output_vector](int a) { output_vector.push_back(a); });
+  }
+
+  EXPECT_EQ(n_values, output_vector.size());
+  for (auto i = 0; i < n_values; ++i) {
+    EXPECT_EQ(i, output_vector[i]);
+  }
+}
+
+TEST_F(SpscBufferTest, SingleWriterSingleReaderSlowReads) {
+  auto output_vector = std::vector<int>{};
+
+  auto writer = std::jthread([this]() {
+    for (auto i = 0; i < n_values; ++i) {
+      buffer.write_next(i);
+    }
+  });
+  for (auto i = 0; i < n_values; ++i) {
+    buffer.read_next([&output_vector](int a) {
+      using namespace std::chrono_literals;
+      std::this_thread::sleep_for(1us);
+      output_vector.push_back(a);
+    });
+  }
+
+  EXPECT_EQ(n_values, output_vector.size());
+  for (auto i = 0; i < n_values; ++i) {
+    EXPECT_EQ(i, output_vector[i]);
+  }
+}
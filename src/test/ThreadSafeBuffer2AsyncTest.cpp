@@ -0,0 +1,258 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <latch>
+#include <mutex>
+#include <semaphore>
+#include <thread>
+#include <vector>
+
+#include "ThreadSafeBuffer2.hpp"
+
+auto constexpr buffer_size = 16;
+
+// Coroutine that starts suspended, is started by an executor, and destroys
+// itself when it finishes.
+struct Task {
+  struct promise_type {
+    Task get_return_object() {
+      return {std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  std::coroutine_handle<> handle;
+};
+
+// Runs coroutines one at a time on the thread that calls run(), until none is
+// ready to run. A coroutine that blocked its thread would block them all.
+class SingleThreadExecutor {
+ public:
+  void spawn(Task task) { m_ready.push_back(task.handle); }
+
+  void run() {
+    while (not m_ready.empty()) {
+      auto handle = m_ready.front();
+      m_ready.pop_front();
+      handle.resume();
+    }
+  }
+
+ private:
+  std::deque<std::coroutine_handle<>> m_ready;
+};
+
+// Runs coroutines on n_threads threads. A coroutine resumed on another thread
+// by the buffer can move back onto the pool with co_await schedule().
+class ThreadPoolExecutor {
+ public:
+  explicit ThreadPoolExecutor(int n_threads) {
+    for (auto i = 0; i < n_threads; ++i) {
+      m_threads.emplace_back([this]() { work(); });
+    }
+  }
+
+  // Stops the threads once every coroutine that is ready has run.
+  ~ThreadPoolExecutor() { m_n_ready.release(m_threads.size()); }
+
+  void spawn(Task task) { enqueue(task.handle); }
+
+  auto schedule() {
+    struct Awaiter {
+      ThreadPoolExecutor& executor;
+      bool await_ready() { return false; }
+      void await_suspend(std::coroutine_handle<> handle) {
+        executor.enqueue(handle);
+      }
+      void await_resume() {}
+    };
+    return Awaiter{*this};
+  }
+
+ private:
+  std::mutex m_mutex;
+  std::deque<std::coroutine_handle<>> m_ready;
+  // Counts the coroutines that are ready, and one more per thread to stop.
+  std::counting_semaphore<> m_n_ready{0};
+  // Last, so that the threads are joined before the queue is destroyed.
+  std::vector<std::jthread> m_threads;
+
+  void enqueue(std::coroutine_handle<> handle) {
+    {
+      auto lock = std::scoped_lock{m_mutex};
+      m_ready.push_back(handle);
+    }
+    m_n_ready.release();
+  }
+
+  void work() {
+    while (true) {
+      m_n_ready.acquire();
+      auto lock = std::unique_lock{m_mutex};
+      if (m_ready.empty()) {
+        return;
+      }
+      auto handle = m_ready.front();
+      m_ready.pop_front();
+      lock.unlock();
+      handle.resume();
+    }
+  }
+};
+
+template <typename Buffer>
+class ThreadSafeBuffer2AsyncTest : public testing::Test {
+ protected:
+  Buffer buffer{};
+};
+
+using BufferTypes = testing::Types<
+    ThreadSafeBuffer2<int, buffer_size, InOrderRelease, AsyncWaiters>,
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, AsyncWaiters>,
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, SpinThenPark,
+                      AsyncWaiters>>;
+TYPED_TEST_SUITE(ThreadSafeBuffer2AsyncTest, BufferTypes);
+
+template <typename Buffer>
+Task produce(Buffer& buffer, int first, int count) {
+  for (auto i = first; i < first + count; ++i) {
+    co_await buffer.async_write(i);
+  }
+}
+
+template <typename Buffer>
+Task consume(Buffer& buffer, int count, std::vector<int>& output) {
+  for (auto i = 0; i < count; ++i) {
+    output.push_back(co_await buffer.async_read());
+  }
+}
+
+TYPED_TEST(ThreadSafeBuffer2AsyncTest, SingleThreadProducerAndConsumer) {
+  auto constexpr n_values = 100 * buffer_size;
+  for (auto consumer_first : {false, true}) {
+    auto output = std::vector<int>{};
+    auto executor = SingleThreadExecutor{};
+    if (consumer_first) {
+      executor.spawn(consume(this->buffer, n_values, output));
+    }
+    executor.spawn(produce(this->buffer, 0, n_values));
+    if (not consumer_first) {
+      executor.spawn(consume(this->buffer, n_values, output));
+    }
+    executor.run();
+
+    ASSERT_EQ(n_values, output.size());
+    for (auto i = 0; i < n_values; ++i) {
+      EXPECT_EQ(i, output[i]);
+    }
+  }
+}
+
+TYPED_TEST(ThreadSafeBuffer2AsyncTest, SuspendedReaderIsResumedByWrite) {
+  auto output = std::vector<int>{};
+  auto executor = SingleThreadExecutor{};
+  executor.spawn(consume(this->buffer, 1, output));
+  executor.run();
+  EXPECT_TRUE(output.empty());
+
+  this->buffer.write_next(42);
+  EXPECT_EQ(std::vector{42}, output);
+}
+
+TYPED_TEST(ThreadSafeBuffer2AsyncTest, SuspendedWriterIsResumedByRead) {
+  for (auto i = 0; i < buffer_size; ++i) {
+    this->buffer.write_next(i);
+  }
+  auto executor = SingleThreadExecutor{};
+  executor.spawn(produce(this->buffer, buffer_size, 1));
+  executor.run();
+  EXPECT_EQ(buffer_size, this->buffer.size_approx());
+
+  this->buffer.read_next([](int) {});
+  EXPECT_EQ(buffer_size, this->buffer.size_approx());
+  for (auto i = 1; i <= buffer_size; ++i) {
+    auto output = -1;
+    this->buffer.read_next([&output](int value) { output = value; });
+    EXPECT_EQ(i, output);
+  }
+}
+
+TYPED_TEST(ThreadSafeBuffer2AsyncTest, ThreadPoolLosesNoWakeups) {
+  auto constexpr n_threads = 4;
+  auto constexpr n_producers = 8;
+  auto constexpr n_consumers = 8;
+  auto constexpr n_values_per_producer = 5000;
+  auto constexpr n_values_per_consumer =
+      n_producers * n_values_per_producer / n_consumers;
+
+  auto done = std::latch{n_producers + n_consumers};
+  auto sum = std::atomic<std::int64_t>{};
+  auto n_read = std::atomic<int>{};
+  auto& buffer = this->buffer;
+  auto executor = ThreadPoolExecutor{n_threads};
+
+  auto producer = [&](int first) -> Task {
+    for (auto i = first; i < first + n_values_per_producer; ++i) {
+      co_await buffer.async_write(i);
+      // Move back onto the pool from whichever thread resumed us.
+      if (i % 64 == 0) {
+        co_await executor.schedule();
+      }
+    }
+    done.count_down();
+  };
+  auto consumer = [&]() -> Task {
+    for (auto i = 0; i < n_values_per_consumer; ++i) {
+      sum += co_await buffer.async_read();
+      ++n_read;
+      if (i % 64 == 0) {
+        co_await executor.schedule();
+      }
+    }
+    done.count_down();
+  };
+  for (auto p = 0; p < n_producers; ++p) {
+    executor.spawn(producer(p * n_values_per_producer));
+  }
+  for (auto c = 0; c < n_consumers; ++c) {
+    executor.spawn(consumer());
+  }
+  done.wait();
+
+  auto constexpr n_values = n_producers * n_values_per_producer;
+  EXPECT_EQ(n_values, n_read);
+  EXPECT_EQ(std::int64_t{n_values} * (n_values - 1) / 2, sum);
+  EXPECT_TRUE(buffer.empty());
+}
+
+TYPED_TEST(ThreadSafeBuffer2AsyncTest, CoroutinesAndThreadsShareTheBuffer) {
+  auto constexpr n_values = 200 * buffer_size;
+  auto output = std::vector<int>{};
+  auto executor = ThreadPoolExecutor{1};
+  auto done = std::latch{1};
+  auto& buffer = this->buffer;
+
+  auto consumer = [&]() -> Task {
+    for (auto i = 0; i < n_values; ++i) {
+      output.push_back(co_await buffer.async_read());
+    }
+    done.count_down();
+  };
+  executor.spawn(consumer());
+  for (auto i = 0; i < n_values; ++i) {
+    buffer.write_next(i);
+  }
+  done.wait();
+
+  ASSERT_EQ(n_values, output.size());
+  for (auto i = 0; i < n_values; ++i) {
+    EXPECT_EQ(i, output[i]);
+  }
+}
@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <vector>
+
+#include "SpscBuffer.hpp"
+#include "ThreadSafeBuffer2.hpp"
+
+// Stress tests for the memory orderings used by the buffers. Each record is
+// written and read with plain, non-atomic accesses, so any missing
+// happens-before edge between a writer and the reader of the same slot shows
+// up as a torn record here and as a data race when built with
+// -fsanitize=thread (see ThreadSafeBuffer2StressTestTsan).
+
+struct Record {
+  int id{};
+  std::array<int, 15> copies{};
+
+  Record() = default;
+  explicit Record(int i) : id{i} { copies.fill(i); }
+
+  bool intact() const {
+    return std::all_of(copies.begin(), copies.end(),
+                       [this](int c) { return c == id; });
+  }
+};
+
+template <typename Buffer>
+class ThreadSafeBuffer2StressTest : public testing::Test {
+ protected:
+  auto static constexpr n_threads = 8;
+  auto static constexpr n_ops_per_thread = 1 << 13;
+  auto static constexpr n_values = n_threads * n_ops_per_thread;
+
+  Buffer buffer{};
+};
+
+using BufferTypes = testing::Types<
+    ThreadSafeBuffer2<Record, 8, InOrderRelease>,
+    ThreadSafeBuffer2<Record, 8, PerSlotSequence>,
+    ThreadSafeBuffer2<Record, 8, InOrderRelease, PaddedIndicesAndSlots>,
+    ThreadSafeBuffer2<Record, 8, PerSlotSequence, PaddedIndicesAndSlots>,
+    ThreadSafeBuffer2<Record, 8, InOrderRelease, SpinThenPark>,
+    ThreadSafeBuffer2<Record, 8, PerSlotSequence, SpinThenPark>>;
+TYPED_TEST_SUITE(ThreadSafeBuffer2StressTest, BufferTypes);
+
+TYPED_TEST(ThreadSafeBuffer2StressTest, RecordsArriveIntactExactlyOnce) {
+  auto writers = std::vector<std::jthread>{};
+  auto readers = std::vector<std::jthread>{};
+  auto seen = std::vector<std::vector<int>>(this->n_threads);
+  auto torn = std::vector<int>(this->n_threads);
+
+  for (auto i = 0; i < this->n_threads; ++i) {
+    readers.push_back(std::jthread(
+        [this, &seen, &torn](int i) {
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.read_next([&seen, &torn, i](Record const& r) {
+              torn[i] += not r.intact();
+              seen[i].push_back(r.id);
+            });
+          }
+        },
+        i));
+  }
+  for (auto i = 0; i < this->n_threads; ++i) {
+    writers.push_back(std::jthread(
+        [this](int i) {
+          auto thread_offset = i * this->n_ops_per_thread;
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.write_next(Record{thread_offset + j});
+          }
+        },
+        i));
+  }
+  for (auto& r : readers) {
+    r.join();
+  }
+
+  auto all_seen = std::vector<int>{};
+  for (auto i = 0; i < this->n_threads; ++i) {
+    EXPECT_EQ(0, torn[i]);
+    all_seen.insert(all_seen.end(), seen[i].begin(), seen[i].end());
+  }
+  EXPECT_EQ(this->n_values, all_seen.size());
+  std::sort(all_seen.begin(), all_seen.end());
+  for (auto i = 0; auto const& x : all_seen) {
+    EXPECT_EQ(i++, x);
+  }
+}
+
+TYPED_TEST(ThreadSafeBuffer2StressTest, BulkRecordsArriveIntactExactlyOnce) {
+  auto static constexpr chunk_size = 5;
+  auto writers = std::vector<std::jthread>{};
+  auto readers = std::vector<std::jthread>{};
+  auto seen = std::vector<std::vector<int>>(this->n_threads);
+  auto torn = std::vector<int>(this->n_threads);
+
+  for (auto i = 0; i < this->n_threads; ++i) {
+    readers.push_back(std::jthread(
+        [this, &seen, &torn](int i) {
+          for (auto n_read = 0; n_read < this->n_ops_per_thread;) {
+            n_read += this->buffer.read_bulk(
+                [&seen, &torn, i](auto records) {
+                  for (Record const& r : records) {
+                    torn[i] += not r.intact();
+                    seen[i].push_back(r.id);
+                  }
+                },
+                std::min(chunk_size, this->n_ops_per_thread - n_read));
+          }
+        },
+        i));
+  }
+  for (auto i = 0; i < this->n_threads; ++i) {
+    writers.push_back(std::jthread(
+        [this](int i) {
+          auto thread_offset = i * this->n_ops_per_thread;
+          auto records = std::vector<Record>{};
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            records.push_back(Record{thread_offset + j});
+            if (records.size() == chunk_size) {
+              this->buffer.write_bulk(records);
+              records.clear();
+            }
+          }
+          this->buffer.write_bulk(records);
+        },
+        i));
+  }
+  for (auto& r : readers) {
+    r.join();
+  }
+
+  auto all_seen = std::vector<int>{};
+  for (auto i = 0; i < this->n_threads; ++i) {
+    EXPECT_EQ(0, torn[i]);
+    all_seen.insert(all_seen.end(), seen[i].begin(), seen[i].end());
+  }
+  EXPECT_EQ(this->n_values, all_seen.size());
+  std::sort(all_seen.begin(), all_seen.end());
+  for (auto i = 0; auto const& x : all_seen) {
+    EXPECT_EQ(i++, x);
+  }
+}
+
+TEST(SpscBufferStressTest, RecordsArriveIntactInOrder) {
+  auto constexpr n_values = 1 << 16;
+  auto buffer = SpscBuffer<Record, 8>{};
+  auto torn = 0;
+  auto out_of_order = 0;
+
+  auto writer = std::jthread([&buffer]() {
+    for (auto i = 0; i < n_values; ++i) {
+      buffer.write_next(Record{i});
+    }
+  });
+  for (auto i = 0; i < n_values; ++i) {
+    buffer.read_next([&torn, &out_of_order, i](Record const& r) {
+      torn += not r.intact();
+      out_of_order += r.id != i;
+    });
+  }
+
+  EXPECT_EQ(0, torn);
+  EXPECT_EQ(0, out_of_order);
+}
@@ -1,74 +1,117 @@
 #include <gtest/gtest.h>
 
+#include <time.h>
+
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <limits>
 #include <mutex>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <string>
 #include <thread>
 #include <vector>
 
 #include "ThreadSafeBuffer2.hpp"
 
+auto constexpr buffer_size = 16;
+
+// Buffers with dynamic_capacity are given buffer_size at construction.
+template <typename Buffer>
+Buffer make_buffer() {
+  if constexpr (std::constructible_from<Buffer, std::size_t>) {
+    return Buffer(buffer_size);
+  } else {
+    return Buffer{};
+  }
+}
+
+template <typename Buffer>
 class ThreadSafeBuffer2Test : public testing::Test {
  protected:
-  auto static constexpr buffer_size = 16;
   auto static constexpr n_passes = 1024;
   auto static constexpr n_values = n_passes * buffer_size;
 
   auto static constexpr n_threads = 16;
   auto static constexpr n_ops_per_thread = n_values / n_threads;
 
-  ThreadSafeBuffer2<int, buffer_size> buffer{};
+  Buffer buffer = make_buffer<Buffer>();
 };
 
-TEST_F(ThreadSafeBuffer2Test, SingleThreadAlternateWriteRead) {
+using BufferTypes = testing::Types<
+    ThreadSafeBuffer2<int, buffer_size, InOrderRelease>,
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence>,
+    ThreadSafeBuffer2<int, buffer_size, PaddedIndices, InOrderRelease>,
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence,
+                      PaddedIndicesAndSlots>,
+    ThreadSafeBuffer2<int, buffer_size, InOrderRelease, SpinThenPark>,
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, SpinThenPark>,
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, SpinThenYield>,
+    ThreadSafeBuffer2<int, buffer_size, InOrderRelease, ShardedStats<>>,
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, LatencyTracing<>>,
+    ThreadSafeBuffer2<int, dynamic_capacity, InOrderRelease>,
+    ThreadSafeBuffer2<int, dynamic_capacity, PerSlotSequence,
+                      HugePageStorage>>;
+TYPED_TEST_SUITE(ThreadSafeBuffer2Test, BufferTypes);
+
+TYPED_TEST(ThreadSafeBuffer2Test, SingleThreadAlternateWriteRead) {
   auto output_vector = std::vector<int>{};
 
-  for (auto i = 0; i < n_values; ++i) {
-    buffer.write_next(i);
-    buffer.read_next([&output_vector](int a) { output_vector.push_back(a); });
+  for (auto i = 0; i < this->n_values; ++i) {
+    this->buffer.write_next(i);
+    this->buffer.read_next(
+        [&output_vector](int a) { output_vector.push_back(a); });
   }
 
-  EXPECT_EQ(n_values, output_vector.size());
-  for (auto i = 0; i < n_values; ++i) {
+  EXPECT_EQ(this->n_values, output_vector.size());
+  for (auto i = 0; i < this->n_values; ++i) {
     EXPECT_EQ(i, output_vector[i]);
   }
 }
 
-TEST_F(ThreadSafeBuffer2Test, MultipleWritersSingleReader) {
+TYPED_TEST(ThreadSafeBuffer2Test, MultipleWritersSingleReader) {
   auto writers = std::vector<std::jthread>{};
   auto output_vector = std::vector<int>{};
 
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     writers.push_back(std::jthread(
         [this](int i) {
-          auto thread_offset = i * n_ops_per_thread;
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.write_next(thread_offset + j);
+          auto thread_offset = i * this->n_ops_per_thread;
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.write_next(thread_offset + j);
           }
         },
         i));
   }
-  for (auto i = 0; i < n_values; ++i) {
-    buffer.read_next([&output_vector](int a) { output_vector.push_back(a); });
+  for (auto i = 0; i < this->n_values; ++i) {
+    this->buffer.read_next(
+        [&output_vector](int a) { output_vector.push_back(a); });
   }
 
-  EXPECT_EQ(n_values, output_vector.size());
+  EXPECT_EQ(this->n_values, output_vector.size());
   std::sort(output_vector.begin(), output_vector.end());
   for (auto i = 0; auto const& x : output_vector) {
     EXPECT_EQ(i++, x);
   }
 }
 
-TEST_F(ThreadSafeBuffer2Test, SingleWriterMultipleReaders) {
+TYPED_TEST(ThreadSafeBuffer2Test, SingleWriterMultipleReaders) {
   auto readers = std::vector<std::jthread>{};
   auto output_vector = std::vector<int>{};
   auto output_mx = std::mutex{};
 
   // need to start readers before writing on main thread
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     readers.push_back(std::jthread(
         [this](auto read_func) {
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.read_next(read_func);
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.read_next(read_func);
           }
         },
         [&output_vector, &output_mx](int a) {
@@ -76,41 +119,41 @@ TEST_F(ThreadSafeBuffer2Test, SingleWriterMultipleReaders) {
           output_vector.push_back(a);
         }));
   }
-  for (auto i = 0; i < n_values; ++i) {
-    buffer.write_next(i);
+  for (auto i = 0; i < this->n_values; ++i) {
+    this->buffer.write_next(i);
   }
   for (auto& r : readers) {
     r.join();
   }
 
-  EXPECT_EQ(n_values, output_vector.size());
+  EXPECT_EQ(this->n_values, output_vector.size());
   std::sort(output_vector.begin(), output_vector.end());
   for (auto i = 0; auto const& x : output_vector) {
     EXPECT_EQ(i++, x);
   }
 }
 
-TEST_F(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersWriteFirst) {
+TYPED_TEST(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersWriteFirst) {
   auto writers = std::vector<std::jthread>{};
   auto readers = std::vector<std::jthread>{};
   auto output_vector = std::vector<int>{};
   auto output_mx = std::mutex{};
 
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     writers.push_back(std::jthread(
         [this](int i) {
-          auto thread_offset = i * n_ops_per_thread;
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.write_next(thread_offset + j);
+          auto thread_offset = i * this->n_ops_per_thread;
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.write_next(thread_offset + j);
           }
         },
         i));
   }
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     readers.push_back(std::jthread(
         [this](auto read_func) {
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.read_next(read_func);
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.read_next(read_func);
           }
         },
         [&output_vector, &output_mx](int a) {
@@ -122,24 +165,24 @@ TEST_F(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersWriteFirst) {
     r.join();
   }
 
-  EXPECT_EQ(n_values, output_vector.size());
+  EXPECT_EQ(this->n_values, output_vector.size());
   std::sort(output_vector.begin(), output_vector.end());
   for (auto i = 0; auto const& x : output_vector) {
     EXPECT_EQ(i++, x);
   }
 }
 
-TEST_F(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersReadFirst) {
+TYPED_TEST(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersReadFirst) {
   auto writers = std::vector<std::jthread>{};
   auto readers = std::vector<std::jthread>{};
   auto output_vector = std::vector<int>{};
   auto output_mx = std::mutex{};
 
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     readers.push_back(std::jthread(
         [this](auto read_func) {
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.read_next(read_func);
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.read_next(read_func);
           }
         },
         [&output_vector, &output_mx](int a) {
@@ -147,12 +190,12 @@ TEST_F(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersReadFirst) {
           output_vector.push_back(a);
         }));
   }
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     writers.push_back(std::jthread(
         [this](int i) {
-          auto thread_offset = i * n_ops_per_thread;
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.write_next(thread_offset + j);
+          auto thread_offset = i * this->n_ops_per_thread;
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.write_next(thread_offset + j);
           }
         },
         i));
@@ -161,36 +204,36 @@ TEST_F(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersReadFirst) {
     r.join();
   }
 
-  EXPECT_EQ(n_values, output_vector.size());
+  EXPECT_EQ(this->n_values, output_vector.size());
   std::sort(output_vector.begin(), output_vector.end());
   for (auto i = 0; auto const& x : output_vector) {
     EXPECT_EQ(i++, x);
   }
 }
 
-TEST_F(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersSlowWrites) {
+TYPED_TEST(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersSlowWrites) {
   auto writers = std::vector<std::jthread>{};
   auto readers = std::vector<std::jthread>{};
   auto output_vector = std::vector<int>{};
   auto output_mx = std::mutex{};
 
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     writers.push_back(std::jthread(
         [this](int i) {
-          auto thread_offset = i * n_ops_per_thread;
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
+          auto thread_offset = i * this->n_ops_per_thread;
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
             using namespace std::chrono_literals;
             std::this_thread::sleep_for(1us);
-            buffer.write_next(thread_offset + j);
+            this->buffer.write_next(thread_offset + j);
           }
         },
         i));
   }
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     readers.push_back(std::jthread(
         [this](auto read_func) {
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.read_next(read_func);
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.read_next(read_func);
           }
         },
         [&output_vector, &output_mx](int a) {
@@ -202,34 +245,34 @@ TEST_F(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersSlowWrites) {
     r.join();
   }
 
-  EXPECT_EQ(n_values, output_vector.size());
+  EXPECT_EQ(this->n_values, output_vector.size());
   std::sort(output_vector.begin(), output_vector.end());
   for (auto i = 0; auto const& x : output_vector) {
     EXPECT_EQ(i++, x);
   }
 }
 
-TEST_F(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersSlowReads) {
+TYPED_TEST(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersSlowReads) {
   auto writers = std::vector<std::jthread>{};
   auto readers = std::vector<std::jthread>{};
   auto output_vector = std::vector<int>{};
   auto output_mx = std::mutex{};
 
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     writers.push_back(std::jthread(
         [this](int i) {
-          auto thread_offset = i * n_ops_per_thread;
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.write_next(thread_offset + j);
+          auto thread_offset = i * this->n_ops_per_thread;
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.write_next(thread_offset + j);
           }
         },
         i));
   }
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     readers.push_back(std::jthread(
         [this](auto read_func) {
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.read_next(read_func);
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.read_next(read_func);
           }
         },
         [&output_vector, &output_mx](int a) {
@@ -243,49 +286,49 @@ TEST_F(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersSlowReads) {
     r.join();
   }
 
-  EXPECT_EQ(n_values, output_vector.size());
+  EXPECT_EQ(this->n_values, output_vector.size());
   std::sort(output_vector.begin(), output_vector.end());
   for (auto i = 0; auto const& x : output_vector) {
     EXPECT_EQ(i++, x);
   }
 }
 
-TEST_F(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersMixedSpeeds) {
+TYPED_TEST(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersMixedSpeeds) {
   auto writers = std::vector<std::jthread>{};
   auto readers = std::vector<std::jthread>{};
   auto output_vector = std::vector<int>{};
   auto output_mx = std::mutex{};
 
   // slow writes
-  for (auto i = 0; i < n_threads / 2; ++i) {
+  for (auto i = 0; i < this->n_threads / 2; ++i) {
     writers.push_back(std::jthread(
         [this](int i) {
-          auto thread_offset = i * n_ops_per_thread;
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
+          auto thread_offset = i * this->n_ops_per_thread;
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
             using namespace std::chrono_literals;
             std::this_thread::sleep_for(1us);
-            buffer.write_next(thread_offset + j);
+            this->buffer.write_next(thread_offset + j);
           }
         },
         i));
   }
   // fast writes
-  for (auto i = n_threads / 2; i < n_threads; ++i) {
+  for (auto i = this->n_threads / 2; i < this->n_threads; ++i) {
     writers.push_back(std::jthread(
         [this](int i) {
-          auto thread_offset = i * n_ops_per_thread;
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.write_next(thread_offset + j);
+          auto thread_offset = i * this->n_ops_per_thread;
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.write_next(thread_offset + j);
           }
         },
         i));
   }
   // slow reads
-  for (auto i = 0; i < n_threads / 2; ++i) {
+  for (auto i = 0; i < this->n_threads / 2; ++i) {
     readers.push_back(std::jthread(
         [this](auto read_func) {
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.read_next(read_func);
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.read_next(read_func);
           }
         },
         [&output_vector, &output_mx](int a) {
@@ -296,11 +339,11 @@ TEST_F(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersMixedSpeeds) {
         }));
   }
   // fast reads
-  for (auto i = n_threads / 2; i < n_threads; ++i) {
+  for (auto i = this->n_threads / 2; i < this->n_threads; ++i) {
     readers.push_back(std::jthread(
         [this](auto read_func) {
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.read_next(read_func);
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.read_next(read_func);
           }
         },
         [&output_vector, &output_mx](int a) {
@@ -312,9 +355,942 @@ TEST_F(ThreadSafeBuffer2Test, MultipleWritersMultipleReadersMixedSpeeds) {
     r.join();
   }
 
-  EXPECT_EQ(n_values, output_vector.size());
+  EXPECT_EQ(this->n_values, output_vector.size());
+  std::sort(output_vector.begin(), output_vector.end());
+  for (auto i = 0; auto const& x : output_vector) {
+    EXPECT_EQ(i++, x);
+  }
+}
+
+TYPED_TEST(ThreadSafeBuffer2Test, SingleThreadBulkWriteRead) {
+  auto constexpr chunk_size = 10;  // not a divisor of buffer_size
+  auto output_vector = std::vector<int>{};
+
+  for (auto i = 0; i < this->n_values; i += chunk_size) {
+    auto chunk = std::vector<int>{};
+    for (auto j = i; j < std::min(i + chunk_size, this->n_values); ++j) {
+      chunk.push_back(j);
+    }
+    this->buffer.write_bulk(chunk);
+    for (auto n_read = 0u; n_read < chunk.size();) {
+      n_read += this->buffer.read_bulk(
+          [&output_vector](auto values) {
+            output_vector.insert(output_vector.end(), values.begin(),
+                                 values.end());
+          },
+          chunk.size() - n_read);
+    }
+  }
+
+  EXPECT_EQ(this->n_values, output_vector.size());
+  for (auto i = 0; i < this->n_values; ++i) {
+    EXPECT_EQ(i, output_vector[i]);
+  }
+}
+
+TYPED_TEST(ThreadSafeBuffer2Test, TryWriteUpToStopsWhenFull) {
+  auto values = std::vector<int>(buffer_size + 4);
+  std::iota(values.begin(), values.end(), 0);
+
+  EXPECT_EQ(buffer_size, this->buffer.try_write_up_to(values));
+  EXPECT_EQ(0, this->buffer.try_write_up_to(values));
+  this->buffer.read_next([](int a) { EXPECT_EQ(0, a); });
+  EXPECT_EQ(1, this->buffer.try_write_up_to(std::span{values}.last(4)));
+
+  auto output_vector = std::vector<int>{};
+  EXPECT_EQ(buffer_size, this->buffer.read_bulk(
+                             [&output_vector](auto values) {
+                               output_vector.insert(output_vector.end(),
+                                                    values.begin(),
+                                                    values.end());
+                             },
+                             values.size()));
+  EXPECT_EQ(buffer_size, output_vector.size());
+  for (auto i = 1; i < buffer_size; ++i) {
+    EXPECT_EQ(i, output_vector[i - 1]);
+  }
+  EXPECT_EQ(buffer_size, output_vector.back());
+}
+
+TYPED_TEST(ThreadSafeBuffer2Test, MultipleBulkWritersMultipleBulkReaders) {
+  auto static constexpr write_chunk_size = 7;
+  auto static constexpr max_read_size = 5;
+  auto writers = std::vector<std::jthread>{};
+  auto readers = std::vector<std::jthread>{};
+  auto output_vector = std::vector<int>{};
+  auto output_mx = std::mutex{};
+
+  for (auto i = 0; i < this->n_threads; ++i) {
+    readers.push_back(std::jthread([this, &output_vector, &output_mx]() {
+      for (auto n_read = 0; n_read < this->n_ops_per_thread;) {
+        n_read += this->buffer.read_bulk(
+            [&output_vector, &output_mx](auto values) {
+              auto lock = std::lock_guard{output_mx};
+              output_vector.insert(output_vector.end(), values.begin(),
+                                   values.end());
+            },
+            std::min(max_read_size, this->n_ops_per_thread - n_read));
+      }
+    }));
+  }
+  for (auto i = 0; i < this->n_threads; ++i) {
+    writers.push_back(std::jthread(
+        [this](int i) {
+          auto values = std::vector<int>(this->n_ops_per_thread);
+          std::iota(values.begin(), values.end(), i * this->n_ops_per_thread);
+          for (auto chunk = std::span{values}; not chunk.empty();) {
+            auto chunk_size = std::min<std::size_t>(write_chunk_size,
+                                                    chunk.size());
+            this->buffer.write_bulk(chunk.first(chunk_size));
+            chunk = chunk.subspan(chunk_size);
+          }
+        },
+        i));
+  }
+  for (auto& r : readers) {
+    r.join();
+  }
+
+  EXPECT_EQ(this->n_values, output_vector.size());
   std::sort(output_vector.begin(), output_vector.end());
   for (auto i = 0; auto const& x : output_vector) {
     EXPECT_EQ(i++, x);
   }
 }
+
+TYPED_TEST(ThreadSafeBuffer2Test, TryWriteFailsWhenFullTryReadWhenEmpty) {
+  EXPECT_FALSE(this->buffer.try_read_next([](int) {}));
+  for (auto i = 0; i < buffer_size; ++i) {
+    EXPECT_TRUE(this->buffer.try_write_next(i));
+  }
+  EXPECT_FALSE(this->buffer.try_write_next(buffer_size));
+  for (auto i = 0; i < buffer_size; ++i) {
+    EXPECT_TRUE(this->buffer.try_read_next([i](int a) { EXPECT_EQ(i, a); }));
+  }
+  EXPECT_FALSE(this->buffer.try_read_next([](int) {}));
+}
+
+TYPED_TEST(ThreadSafeBuffer2Test, TimedWriteAndReadGiveUpAfterTimeout) {
+  using namespace std::chrono_literals;
+  auto constexpr timeout = 10ms;
+
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_FALSE(this->buffer.read_for([](int) {}, timeout));
+  EXPECT_LE(timeout, std::chrono::steady_clock::now() - start);
+
+  for (auto i = 0; i < buffer_size; ++i) {
+    this->buffer.write_next(i);
+  }
+  start = std::chrono::steady_clock::now();
+  EXPECT_FALSE(this->buffer.write_until(buffer_size, start + timeout));
+  EXPECT_LE(timeout, std::chrono::steady_clock::now() - start);
+}
+
+TYPED_TEST(ThreadSafeBuffer2Test, TimedWriteAndReadSucceedOnceUnblocked) {
+  using namespace std::chrono_literals;
+  for (auto i = 0; i < buffer_size; ++i) {
+    this->buffer.write_next(i);
+  }
+
+  auto reader = std::jthread([this]() {
+    std::this_thread::sleep_for(10ms);
+    this->buffer.read_next([](int a) { EXPECT_EQ(0, a); });
+  });
+  EXPECT_TRUE(this->buffer.write_for(buffer_size, 10s));
+  reader.join();
+
+  for (auto i = 1; i <= buffer_size; ++i) {
+    this->buffer.read_next([i](int a) { EXPECT_EQ(i, a); });
+  }
+  auto writer = std::jthread([this]() {
+    std::this_thread::sleep_for(10ms);
+    this->buffer.write_next(-1);
+  });
+  EXPECT_TRUE(this->buffer.read_until([](int a) { EXPECT_EQ(-1, a); },
+                                      std::chrono::steady_clock::now() + 10s));
+}
+
+TYPED_TEST(ThreadSafeBuffer2Test, MultipleTryWritersMultipleTryReaders) {
+  auto writers = std::vector<std::jthread>{};
+  auto readers = std::vector<std::jthread>{};
+  auto output_vector = std::vector<int>{};
+  auto output_mx = std::mutex{};
+
+  for (auto i = 0; i < this->n_threads; ++i) {
+    readers.push_back(std::jthread(
+        [this](auto read_func) {
+          for (auto j = 0; j < this->n_ops_per_thread;) {
+            if (this->buffer.try_read_next(read_func)) {
+              ++j;
+            } else {
+              std::this_thread::yield();
+            }
+          }
+        },
+        [&output_vector, &output_mx](int a) {
+          auto lock = std::lock_guard{output_mx};
+          output_vector.push_back(a);
+        }));
+  }
+  for (auto i = 0; i < this->n_threads; ++i) {
+    writers.push_back(std::jthread(
+        [this](int i) {
+          auto thread_offset = i * this->n_ops_per_thread;
+          for (auto j = 0; j < this->n_ops_per_thread;) {
+            if (this->buffer.try_write_next(thread_offset + j)) {
+              ++j;
+            } else {
+              std::this_thread::yield();
+            }
+          }
+        },
+        i));
+  }
+  for (auto& r : readers) {
+    r.join();
+  }
+
+  EXPECT_EQ(this->n_values, output_vector.size());
+  std::sort(output_vector.begin(), output_vector.end());
+  for (auto i = 0; auto const& x : output_vector) {
+    EXPECT_EQ(i++, x);
+  }
+}
+
+TYPED_TEST(ThreadSafeBuffer2Test, SizeTracksWritesAndReads) {
+  EXPECT_EQ(buffer_size, this->buffer.capacity());
+  EXPECT_TRUE(this->buffer.empty());
+  EXPECT_EQ(0, this->buffer.size_approx());
+
+  for (auto i = 0; i < buffer_size; ++i) {
+    this->buffer.write_next(i);
+    EXPECT_EQ(i + 1, this->buffer.size_approx());
+  }
+  EXPECT_TRUE(this->buffer.full());
+  // The read-only queries leave the watermark alone.
+  EXPECT_EQ(0, this->buffer.high_watermark());
+  EXPECT_EQ(buffer_size, this->buffer.sample_size());
+  for (auto i = 0; i < buffer_size / 2; ++i) {
+    this->buffer.read_next([](int) {});
+  }
+  EXPECT_EQ(buffer_size / 2, this->buffer.size_approx());
+  EXPECT_FALSE(this->buffer.empty());
+  EXPECT_FALSE(this->buffer.full());
+
+  EXPECT_EQ(buffer_size, this->buffer.high_watermark());
+  EXPECT_EQ(buffer_size, this->buffer.reset_high_watermark());
+  EXPECT_EQ(0, this->buffer.high_watermark());
+  EXPECT_EQ(buffer_size / 2, this->buffer.sample_size());
+  EXPECT_EQ(buffer_size / 2, this->buffer.high_watermark());
+}
+
+TYPED_TEST(ThreadSafeBuffer2Test, ClaimedReadHoldsSlotUntilReleased) {
+  for (auto i = 0; i < buffer_size; ++i) {
+    this->buffer.write_next(i);
+  }
+
+  auto claim = this->buffer.claim_read();
+  EXPECT_EQ(0, *claim);
+  EXPECT_FALSE(this->buffer.try_write_next(buffer_size));
+  claim.release();
+  EXPECT_TRUE(this->buffer.try_write_next(buffer_size));
+
+  for (auto i = 1; i <= buffer_size; ++i) {
+    EXPECT_EQ(i, *this->buffer.claim_read());
+  }
+  EXPECT_FALSE(this->buffer.try_read_next([](int) {}));
+}
+
+// Each slot is first filled with a nonzero value and read, so that a value
+// left indeterminate in a reused slot would likely show up as nonzero.
+TYPED_TEST(ThreadSafeBuffer2Test, DroppedClaimPublishesValueInitializedValue) {
+  for (auto i = 0; i < buffer_size; ++i) {
+    this->buffer.write_next(-1);
+    this->buffer.read_next([](int) {});
+  }
+
+  { auto claim = this->buffer.claim_write(); }
+  this->buffer.read_next([](int a) { EXPECT_EQ(0, a); });
+}
+
+TYPED_TEST(ThreadSafeBuffer2Test, ClaimAbandonedByExceptionIsNotPublished) {
+  EXPECT_THROW(
+      {
+        auto claim = this->buffer.claim_write();
+        claim.emplace(1);
+        throw std::runtime_error{"producer failed"};
+      },
+      std::runtime_error);
+  this->buffer.write_next(2);
+
+  this->buffer.read_next([](int a) { EXPECT_EQ(0, a); });
+  this->buffer.read_next([](int a) { EXPECT_EQ(2, a); });
+}
+
+TYPED_TEST(ThreadSafeBuffer2Test, MultipleWritersMultipleClaimingReaders) {
+  auto writers = std::vector<std::jthread>{};
+  auto readers = std::vector<std::jthread>{};
+  auto output_vector = std::vector<int>{};
+  auto output_mx = std::mutex{};
+
+  // Half the readers hold a claim while recording the value, the other half
+  // move the value out first.
+  for (auto i = 0; i < this->n_threads; ++i) {
+    readers.push_back(std::jthread(
+        [this, &output_vector, &output_mx](bool consume) {
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            auto value = 0;
+            if (consume) {
+              this->buffer.consume_into(value);
+            } else {
+              value = *this->buffer.claim_read();
+            }
+            auto lock = std::lock_guard{output_mx};
+            output_vector.push_back(value);
+          }
+        },
+        i % 2 == 0));
+  }
+  for (auto i = 0; i < this->n_threads; ++i) {
+    writers.push_back(std::jthread(
+        [this](int i) {
+          auto thread_offset = i * this->n_ops_per_thread;
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.write_next(thread_offset + j);
+          }
+        },
+        i));
+  }
+  for (auto& r : readers) {
+    r.join();
+  }
+
+  EXPECT_EQ(this->n_values, output_vector.size());
+  std::sort(output_vector.begin(), output_vector.end());
+  for (auto i = 0; auto const& x : output_vector) {
+    EXPECT_EQ(i++, x);
+  }
+}
+
+TEST(ThreadSafeBuffer2TryWriteTest, FailedWriteLeavesValueUntouched) {
+  auto buffer = ThreadSafeBuffer2<std::string, 1>{};
+  auto value = std::string{"a string long enough to be heap allocated"};
+
+  EXPECT_TRUE(buffer.try_write_next(std::string{"first"}));
+  EXPECT_FALSE(buffer.try_write_next(std::move(value)));
+  using namespace std::chrono_literals;
+  EXPECT_FALSE(buffer.write_for(std::move(value), 1ms));
+  EXPECT_EQ("a string long enough to be heap allocated", value);
+}
+
+TEST(ThreadSafeBuffer2DynamicCapacityTest, CapacityRoundsUpToPowerOf2) {
+  auto buffer = ThreadSafeBuffer2<int, dynamic_capacity>{1000};
+  EXPECT_EQ(1024u, buffer.capacity());
+
+  for (auto i = 0; i < 1024; ++i) {
+    EXPECT_TRUE(buffer.try_write_next(i));
+  }
+  EXPECT_FALSE(buffer.try_write_next(1024));
+  for (auto i = 0; i < 1024; ++i) {
+    buffer.read_next([i](int a) { EXPECT_EQ(i, a); });
+  }
+}
+
+TEST(ThreadSafeBuffer2DynamicCapacityTest, TooLargeCapacityThrows) {
+  using Buffer = ThreadSafeBuffer2<int, dynamic_capacity>;
+  EXPECT_THROW(Buffer{(std::size_t{1} << 31) + 1}, std::length_error);
+}
+
+TEST(ThreadSafeBuffer2DynamicCapacityTest, LargeHugePageBufferWrapsAround) {
+  auto static constexpr capacity = std::size_t{1} << 20;
+  auto buffer = ThreadSafeBuffer2<std::size_t, dynamic_capacity,
+                                  PerSlotSequence, HugePageStorage>{capacity};
+  ASSERT_EQ(capacity, buffer.capacity());
+
+  auto values = std::vector<std::size_t>(capacity / 4);
+  for (auto pass = std::size_t{}; pass < 6; ++pass) {
+    std::iota(values.begin(), values.end(), pass * values.size());
+    buffer.write_bulk(values);
+    auto next = pass * values.size();
+    while (next < (pass + 1) * values.size()) {
+      buffer.read_bulk(
+          [&next](auto values) {
+            for (auto a : values) {
+              ASSERT_EQ(next++, a);
+            }
+          },
+          capacity);
+    }
+  }
+}
+
+// Counts its constructions and destructions, and has no default constructor.
+struct CountedValue {
+  int value;
+
+  static inline auto n_constructed = 0;
+  static inline auto n_moved = 0;
+  static inline auto n_destroyed = 0;
+
+  explicit CountedValue(int v) : value{v} { ++n_constructed; }
+  CountedValue(CountedValue&& other) : value{other.value} { ++n_moved; }
+  CountedValue& operator=(CountedValue&& other) {
+    value = other.value;
+    ++n_moved;
+    return *this;
+  }
+  ~CountedValue() { ++n_destroyed; }
+
+  static void reset() { n_constructed = n_moved = n_destroyed = 0; }
+};
+
+template <typename Buffer>
+class ThreadSafeBuffer2EmplaceTest : public testing::Test {
+ protected:
+  void SetUp() override { CountedValue::reset(); }
+};
+
+using EmplaceBufferTypes = testing::Types<
+    ThreadSafeBuffer2<CountedValue, buffer_size, InOrderRelease>,
+    ThreadSafeBuffer2<CountedValue, buffer_size, PerSlotSequence>>;
+TYPED_TEST_SUITE(ThreadSafeBuffer2EmplaceTest, EmplaceBufferTypes);
+
+TYPED_TEST(ThreadSafeBuffer2EmplaceTest, EmplaceConstructsInPlace) {
+  auto buffer = TypeParam{};
+  for (auto i = 0; i < 4 * buffer_size; ++i) {
+    buffer.emplace_next(i);
+    buffer.read_next([i](CountedValue const& a) { EXPECT_EQ(i, a.value); });
+  }
+
+  EXPECT_EQ(4 * buffer_size, CountedValue::n_constructed);
+  EXPECT_EQ(0, CountedValue::n_moved);
+  EXPECT_EQ(4 * buffer_size, CountedValue::n_destroyed);
+}
+
+TYPED_TEST(ThreadSafeBuffer2EmplaceTest, ClaimedSlotIsFilledInPlace) {
+  auto buffer = TypeParam{};
+  for (auto i = 0; i < 4 * buffer_size; ++i) {
+    auto claim = buffer.claim_write();
+    claim.emplace(-1).value = i;
+    claim.commit();
+    buffer.read_next([i](CountedValue const& a) { EXPECT_EQ(i, a.value); });
+  }
+
+  EXPECT_EQ(4 * buffer_size, CountedValue::n_constructed);
+  EXPECT_EQ(0, CountedValue::n_moved);
+}
+
+TYPED_TEST(ThreadSafeBuffer2EmplaceTest, UncommittedClaimIsCommitted) {
+  auto buffer = TypeParam{};
+  {
+    auto claim = buffer.claim_write();
+    claim.emplace(1);
+  }
+  buffer.emplace_next(2);
+
+  buffer.read_next([](CountedValue const& a) { EXPECT_EQ(1, a.value); });
+  buffer.read_next([](CountedValue const& a) { EXPECT_EQ(2, a.value); });
+}
+
+TYPED_TEST(ThreadSafeBuffer2EmplaceTest, UnreadValuesAreDestroyed) {
+  {
+    auto buffer = TypeParam{};
+    for (auto i = 0; i < buffer_size; ++i) {
+      buffer.emplace_next(i);
+    }
+    buffer.read_next([](CountedValue const&) {});
+    EXPECT_EQ(1, CountedValue::n_destroyed);
+  }
+  EXPECT_EQ(buffer_size, CountedValue::n_destroyed);
+}
+
+TYPED_TEST(ThreadSafeBuffer2EmplaceTest, ReadClaimDestroysValueOnce) {
+  auto buffer = TypeParam{};
+  buffer.emplace_next(1);
+  buffer.emplace_next(2);
+
+  auto claims = std::vector<typename TypeParam::ReadClaim>{};
+  claims.push_back(buffer.claim_read());
+  claims.push_back(buffer.claim_read());
+  EXPECT_EQ(1, claims[0]->value);
+  EXPECT_EQ(2, claims[1]->value);
+  EXPECT_EQ(0, CountedValue::n_destroyed);
+  claims.clear();
+  EXPECT_EQ(2, CountedValue::n_destroyed);
+  EXPECT_EQ(0, CountedValue::n_moved);
+}
+
+TYPED_TEST(ThreadSafeBuffer2EmplaceTest, ConsumeIntoMovesValueOut) {
+  auto buffer = TypeParam{};
+  buffer.emplace_next(1);
+
+  auto value = CountedValue{0};
+  buffer.consume_into(value);
+  EXPECT_EQ(1, value.value);
+  EXPECT_EQ(1, CountedValue::n_destroyed);
+}
+
+template <typename Buffer>
+class ThreadSafeBuffer2WrapTest : public testing::Test {
+ protected:
+  auto static constexpr n_values = 1024 * buffer_size;
+  auto static constexpr n_threads = 8;
+  auto static constexpr n_ops_per_thread = n_values / n_threads;
+
+  Buffer buffer{};
+};
+
+using WrapBufferTypes = testing::Types<
+    ThreadSafeBuffer2<int, buffer_size, InOrderRelease, Tickets32>,
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, Tickets32>,
+    ThreadSafeBuffer2<int, buffer_size, InOrderRelease, Tickets64>,
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, Tickets64>>;
+TYPED_TEST_SUITE(ThreadSafeBuffer2WrapTest, WrapBufferTypes);
+
+TYPED_TEST(ThreadSafeBuffer2WrapTest, SizeAcrossTicketWrap) {
+  using Ticket = typename TypeParam::ticket_type;
+  this->buffer.fast_forward(std::numeric_limits<Ticket>::max() - 1);
+
+  for (auto i = 0; i < buffer_size; ++i) {
+    this->buffer.write_next(i);
+  }
+  EXPECT_TRUE(this->buffer.full());
+  for (auto i = 0; i < buffer_size; ++i) {
+    this->buffer.read_next([i](int a) { EXPECT_EQ(i, a); });
+  }
+  EXPECT_TRUE(this->buffer.empty());
+}
+
+// Starts the tickets halfway through the values from wrapping around, and
+// moves the values with single and bulk writes and reads across the wrap.
+TYPED_TEST(ThreadSafeBuffer2WrapTest, TicketWrapUnderLoad) {
+  using Ticket = typename TypeParam::ticket_type;
+  this->buffer.fast_forward(std::numeric_limits<Ticket>::max() -
+                            this->n_values / 2);
+
+  auto writers = std::vector<std::jthread>{};
+  auto readers = std::vector<std::jthread>{};
+  auto output_vector = std::vector<int>{};
+  auto output_mx = std::mutex{};
+
+  for (auto i = 0; i < this->n_threads; ++i) {
+    readers.push_back(std::jthread(
+        [this, &output_vector, &output_mx](bool bulk) {
+          auto record = [&output_vector, &output_mx](auto values) {
+            auto lock = std::lock_guard{output_mx};
+            output_vector.insert(output_vector.end(), values.begin(),
+                                 values.end());
+          };
+          for (auto n_read = 0; n_read < this->n_ops_per_thread;) {
+            if (bulk) {
+              n_read += this->buffer.read_bulk(record,
+                                               this->n_ops_per_thread - n_read);
+            } else {
+              this->buffer.read_next(
+                  [&record](int a) { record(std::span{&a, 1}); });
+              ++n_read;
+            }
+          }
+        },
+        i % 2 == 0));
+  }
+  for (auto i = 0; i < this->n_threads; ++i) {
+    writers.push_back(std::jthread(
+        [this](int i) {
+          auto values = std::vector<int>(this->n_ops_per_thread);
+          std::iota(values.begin(), values.end(), i * this->n_ops_per_thread);
+          if (i % 2 == 0) {
+            this->buffer.write_bulk(values);
+          } else {
+            for (auto value : values) {
+              this->buffer.write_next(value);
+            }
+          }
+        },
+        i));
+  }
+  for (auto& r : readers) {
+    r.join();
+  }
+
+  EXPECT_EQ(this->n_values, output_vector.size());
+  std::sort(output_vector.begin(), output_vector.end());
+  for (auto i = 0; auto const& x : output_vector) {
+    EXPECT_EQ(i++, x);
+  }
+}
+
+template <typename Buffer>
+class ThreadSafeBuffer2TryTest : public testing::Test {};
+
+// With InOrderRelease, a stale index makes the claim CAS fail, so only
+// PerSlotSequence can mistake it for a full or empty buffer.
+using TryBufferTypes = testing::Types<
+    ThreadSafeBuffer2<int, dynamic_capacity, PerSlotSequence, Tickets32>,
+    ThreadSafeBuffer2<int, dynamic_capacity, PerSlotSequence, Tickets64>>;
+TYPED_TEST_SUITE(ThreadSafeBuffer2TryTest, TryBufferTypes);
+
+// The buffer starts half full, with the tickets about to wrap around, and no
+// more values are written or read than half the capacity, so every try must
+// succeed: a reader never reaches a value that is not yet written, and a
+// writer never reaches a value that is not yet read. A try whose index goes
+// stale while another thread claims past it must retry rather than report
+// the buffer full or empty. The capacity is large so that there are enough
+// tries for that to happen.
+TYPED_TEST(ThreadSafeBuffer2TryTest,
+           TriesDoNotFailWhileBufferIsNeitherFullNorEmpty) {
+  using Ticket = typename TypeParam::ticket_type;
+  auto constexpr capacity = 1 << 22;
+  auto constexpr n_threads = 8;
+  auto constexpr n_ops_per_thread = capacity / 2 / n_threads;
+  auto buffer = TypeParam(capacity);
+  buffer.fast_forward(std::numeric_limits<Ticket>::max() - capacity);
+  for (auto i = 0; i < capacity / 2; ++i) {
+    buffer.write_next(i);
+  }
+
+  auto n_failed_writes = std::atomic<int>{};
+  auto n_failed_reads = std::atomic<int>{};
+  {
+    auto threads = std::vector<std::jthread>{};
+    for (auto t = 0; t < n_threads; ++t) {
+      threads.emplace_back([&buffer, &n_failed_writes]() {
+        for (auto i = 0; i < n_ops_per_thread; ++i) {
+          n_failed_writes += not buffer.try_write_next(i);
+        }
+      });
+      threads.emplace_back([&buffer, &n_failed_reads]() {
+        for (auto i = 0; i < n_ops_per_thread; ++i) {
+          n_failed_reads += not buffer.try_read_next([](int) {});
+        }
+      });
+    }
+  }
+
+  EXPECT_EQ(0, n_failed_writes.load());
+  EXPECT_EQ(0, n_failed_reads.load());
+  EXPECT_EQ(std::size_t{capacity / 2}, buffer.size_approx());
+}
+
+TEST(ThreadSafeBuffer2StatsTest, CountsOperationsAndStalls) {
+  auto buffer = ThreadSafeBuffer2<int, buffer_size, ShardedStats<>>{};
+  for (auto i = 0; i < buffer_size; ++i) {
+    buffer.write_next(i);
+  }
+  EXPECT_FALSE(buffer.try_write_next(buffer_size));
+  for (auto i = 0; i < buffer_size / 2; ++i) {
+    buffer.read_next([](int) {});
+  }
+
+  auto stats = buffer.stats_snapshot();
+  EXPECT_EQ(buffer_size, stats.writes);
+  EXPECT_EQ(buffer_size / 2, stats.reads);
+  EXPECT_EQ(1, stats.full_stalls);
+  EXPECT_EQ(0, stats.empty_stalls);
+  EXPECT_EQ(buffer_size, stats.max_occupancy);
+
+  buffer.read_bulk([](auto) {}, buffer_size);
+  EXPECT_FALSE(buffer.try_read_next([](int) {}));
+  stats = buffer.stats_snapshot();
+  EXPECT_EQ(buffer_size, stats.reads);
+  EXPECT_EQ(1, stats.empty_stalls);
+}
+
+// With more threads than shards, threads share shards but no count is lost.
+TEST(ThreadSafeBuffer2StatsTest, SumsCountsOverSharedShards) {
+  auto static constexpr n_threads = 8;
+  auto static constexpr n_ops_per_thread = 4096;
+  auto buffer =
+      ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, ShardedStats<2>>{};
+
+  {
+    auto threads = std::vector<std::jthread>{};
+    for (auto i = 0; i < n_threads; ++i) {
+      threads.push_back(std::jthread([&buffer, i]() {
+        for (auto j = 0; j < n_ops_per_thread; ++j) {
+          if (i % 2 == 0) {
+            buffer.write_next(j);
+          } else {
+            buffer.read_next([](int) {});
+          }
+        }
+      }));
+    }
+  }
+
+  auto stats = buffer.stats_snapshot();
+  EXPECT_EQ(n_threads / 2 * n_ops_per_thread, stats.writes);
+  EXPECT_EQ(n_threads / 2 * n_ops_per_thread, stats.reads);
+  EXPECT_GE(buffer_size, stats.max_occupancy);
+}
+
+template <typename Buffer>
+class ThreadSafeBuffer2LatencyTest : public testing::Test {};
+
+using LatencyBufferTypes = testing::Types<
+#if defined(__x86_64__) or defined(__i386__)
+    ThreadSafeBuffer2<int, buffer_size, LatencyTracing<TscClock>>,
+#endif
+    ThreadSafeBuffer2<int, buffer_size, LatencyTracing<>>>;
+TYPED_TEST_SUITE(ThreadSafeBuffer2LatencyTest, LatencyBufferTypes);
+
+TYPED_TEST(ThreadSafeBuffer2LatencyTest, RecordsTimeValuesWaited) {
+  auto buffer = TypeParam{};
+  auto static constexpr wait_ns = std::uint64_t{20'000'000};
+
+  auto values = std::vector<int>(4, 0);
+  buffer.write_bulk(values);
+  std::this_thread::sleep_for(std::chrono::nanoseconds{wait_ns});
+  auto reader = std::jthread([&buffer]() {
+    buffer.read_next([](int) {});
+    buffer.read_bulk([](auto) {}, buffer_size);
+  });
+  reader.join();
+  buffer.write_next(0);
+  buffer.read_next([](int) {});
+
+  auto histogram = buffer.latency_histogram();
+  EXPECT_EQ(5u, histogram.count());
+  EXPECT_GT(wait_ns, histogram.percentile(20.0));
+  EXPECT_LE(wait_ns, histogram.percentile(40.0));
+  EXPECT_GT(50 * wait_ns, histogram.percentile(100.0));
+}
+
+TEST(ThreadSafeBuffer2LatencyTest, DroppedValuesAreNotRecorded) {
+  auto buffer = ThreadSafeBuffer2<int, buffer_size, PerSlotSequence,
+                                  OverwriteOldest, LatencyTracing<>>{};
+  for (auto i = 0; i < 2 * buffer_size; ++i) {
+    buffer.write_next(i);
+  }
+  buffer.read_bulk([](auto) {}, buffer_size);
+
+  EXPECT_EQ(buffer_size, buffer.dropped_count());
+  EXPECT_EQ(buffer_size, buffer.latency_histogram().count());
+}
+
+template <typename Buffer>
+class ThreadSafeBuffer2OverwriteTest : public testing::Test {
+ protected:
+  Buffer buffer{};
+};
+
+using OverwriteBufferTypes = testing::Types<
+    ThreadSafeBuffer2<int, buffer_size, InOrderRelease, OverwriteOldest>,
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, OverwriteOldest>>;
+TYPED_TEST_SUITE(ThreadSafeBuffer2OverwriteTest, OverwriteBufferTypes);
+
+TYPED_TEST(ThreadSafeBuffer2OverwriteTest, WritesToFullBufferDropOldest) {
+  for (auto i = 0; i < 2 * buffer_size; ++i) {
+    this->buffer.write_next(i);
+  }
+  EXPECT_TRUE(this->buffer.try_write_next(2 * buffer_size));
+  auto values = std::vector<int>(buffer_size / 2);
+  std::iota(values.begin(), values.end(), 2 * buffer_size + 1);
+  this->buffer.write_bulk(values);
+
+  auto n_written = 2 * buffer_size + 1 + buffer_size / 2;
+  EXPECT_EQ(n_written - buffer_size, this->buffer.dropped_count());
+  EXPECT_TRUE(this->buffer.full());
+  for (auto i = n_written - buffer_size; i < n_written; ++i) {
+    this->buffer.read_next([i](int a) { EXPECT_EQ(i, a); });
+  }
+  EXPECT_TRUE(this->buffer.empty());
+}
+
+TYPED_TEST(ThreadSafeBuffer2OverwriteTest, WriterWaitsForHeldReadClaim) {
+  for (auto i = 0; i < buffer_size; ++i) {
+    this->buffer.write_next(i);
+  }
+  auto claim = this->buffer.claim_read();
+  // The oldest slot is still being read, so there is nothing to drop.
+  EXPECT_FALSE(this->buffer.try_write_next(buffer_size));
+  claim.release();
+  EXPECT_TRUE(this->buffer.try_write_next(buffer_size));
+  EXPECT_EQ(0u, this->buffer.dropped_count());
+}
+
+// Writers never wait for the buffer to drain, and every value is either read
+// exactly once or dropped.
+TYPED_TEST(ThreadSafeBuffer2OverwriteTest, FastWritersSlowReaders) {
+  auto static constexpr n_threads = 4;
+  auto static constexpr n_ops_per_thread = 64 * buffer_size;
+  auto output_vector = std::vector<int>{};
+  auto output_mx = std::mutex{};
+  auto writers_done = std::atomic<bool>{};
+
+  {
+    auto readers = std::vector<std::jthread>{};
+    for (auto i = 0; i < n_threads; ++i) {
+      readers.push_back(std::jthread([this, &output_vector, &output_mx,
+                                      &writers_done]() {
+        auto record = [&output_vector, &output_mx](int a) {
+          auto lock = std::lock_guard{output_mx};
+          output_vector.push_back(a);
+          std::this_thread::yield();
+        };
+        // The flag is checked before the read, so that no value written
+        // before it was set can be missed.
+        for (auto done = false; not done;) {
+          done = writers_done.load();
+          done = not this->buffer.try_read_next(record) and done;
+        }
+      }));
+    }
+    {
+      auto writers = std::vector<std::jthread>{};
+      for (auto i = 0; i < n_threads; ++i) {
+        writers.push_back(std::jthread(
+            [this](int i) {
+              for (auto j = 0; j < n_ops_per_thread; ++j) {
+                this->buffer.write_next(i * n_ops_per_thread + j);
+              }
+            },
+            i));
+      }
+    }
+    writers_done.store(true);
+  }
+
+  EXPECT_EQ(n_threads * n_ops_per_thread,
+            output_vector.size() + this->buffer.dropped_count());
+  std::sort(output_vector.begin(), output_vector.end());
+  EXPECT_EQ(output_vector.end(),
+            std::adjacent_find(output_vector.begin(), output_vector.end()));
+}
+
+// BusySpin never gives up the CPU, so this uses a single writer and reader to
+// keep the test fast on machines with few cores.
+TEST(ThreadSafeBuffer2WaitPolicyTest, BusySpinSingleWriterSingleReader) {
+  auto constexpr n_values = 1 << 12;
+  auto buffer =
+      ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, BusySpin>{};
+  auto output_vector = std::vector<int>{};
+
+  auto writer = std::jthread([&buffer]() {
+    for (auto i = 0; i < n_values; ++i) {
+      buffer.write_next(i);
+    }
+  });
+  for (auto i = 0; i < n_values; ++i) {
+    buffer.read_next([&output_vector](int a) { output_vector.push_back(a); });
+  }
+
+  EXPECT_EQ(n_values, output_vector.size());
+  for (auto i = 0; i < n_values; ++i) {
+    EXPECT_EQ(i, output_vector[i]);
+  }
+}
+
+template <typename Buffer>
+class ThreadSafeBuffer2ParkTest : public testing::Test {
+ protected:
+  Buffer buffer{};
+};
+
+using ParkingBufferTypes = testing::Types<
+    ThreadSafeBuffer2<int, buffer_size, InOrderRelease, SpinThenPark>,
+    ThreadSafeBuffer2<int, buffer_size, PerSlotSequence, SpinThenPark>>;
+TYPED_TEST_SUITE(ThreadSafeBuffer2ParkTest, ParkingBufferTypes);
+
+TYPED_TEST(ThreadSafeBuffer2ParkTest, IdleReaderUsesNoCpuAndWakes) {
+  using namespace std::chrono_literals;
+  auto constexpr idle_time = 200ms;
+  auto reader_cpu_time = std::chrono::nanoseconds{};
+  auto value_read = 0;
+
+  auto reader = std::jthread([this, &reader_cpu_time, &value_read]() {
+    auto thread_cpu_time = []() {
+      auto ts = timespec{};
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+      return std::chrono::seconds{ts.tv_sec} +
+             std::chrono::nanoseconds{ts.tv_nsec};
+    };
+    auto start = thread_cpu_time();
+    this->buffer.read_next([&value_read](int a) { value_read = a; });
+    reader_cpu_time = thread_cpu_time() - start;
+  });
+  std::this_thread::sleep_for(idle_time);
+  this->buffer.write_next(42);
+  reader.join();
+
+  EXPECT_EQ(42, value_read);
+  EXPECT_GT(idle_time / 10, reader_cpu_time);
+}
+
+TYPED_TEST(ThreadSafeBuffer2ParkTest, BlockedWriterWakes) {
+  using namespace std::chrono_literals;
+  for (auto i = 0; i < buffer_size; ++i) {
+    this->buffer.write_next(i);
+  }
+
+  auto writer = std::jthread([this]() { this->buffer.write_next(-1); });
+  std::this_thread::sleep_for(50ms);
+  for (auto i = 0; i < buffer_size; ++i) {
+    this->buffer.read_next([i](int a) { EXPECT_EQ(i, a); });
+  }
+  writer.join();
+  this->buffer.read_next([](int a) { EXPECT_EQ(-1, a); });
+}
+
+// Move-constructing a StallingValue marked as stalling blocks until
+// stalls_released is set, simulating a writer that is descheduled after
+// acquiring its index.
+struct StallingValue {
+  int value{};
+  bool stalling{};
+
+  static inline auto stall_entered = std::atomic<bool>{};
+  static inline auto stalls_released = std::atomic<bool>{};
+
+  StallingValue(int v, bool s = false) : value{v}, stalling{s} {}
+  StallingValue(StallingValue&& other) : value{other.value} {
+    if (other.stalling) {
+      stall_entered.store(true);
+      while (not stalls_released.load()) {
+        std::this_thread::yield();
+      }
+    }
+  }
+};
+
+TEST(ThreadSafeBuffer2PerSlotSequenceTest, HeldReadClaimDoesNotBlockOthers) {
+  auto buffer = ThreadSafeBuffer2<int, buffer_size, PerSlotSequence>{};
+  for (auto i = 0; i < buffer_size; ++i) {
+    buffer.write_next(i);
+  }
+
+  auto held_claim = buffer.claim_read();
+  auto later_reads = std::async(std::launch::async, [&buffer]() {
+    for (auto i = 1; i < buffer_size; ++i) {
+      buffer.read_next([i](int a) { EXPECT_EQ(i, a); });
+    }
+  });
+  using namespace std::chrono_literals;
+  EXPECT_EQ(std::future_status::ready, later_reads.wait_for(10s));
+  EXPECT_EQ(0, *held_claim);
+}
+
+TEST(ThreadSafeBuffer2PerSlotSequenceTest, StalledWriterDoesNotBlockOthers) {
+  auto buffer =
+      ThreadSafeBuffer2<StallingValue, buffer_size, PerSlotSequence>{};
+
+  auto stalled_writer = std::jthread(
+      [&buffer]() { buffer.write_next(StallingValue{0, true}); });
+  while (not StallingValue::stall_entered.load()) {
+    std::this_thread::yield();
+  }
+  auto later_writes = std::async(std::launch::async, [&buffer]() {
+    for (auto i = 1; i < buffer_size; ++i) {
+      buffer.write_next(StallingValue{i});
+    }
+  });
+  using namespace std::chrono_literals;
+  EXPECT_EQ(std::future_status::ready, later_writes.wait_for(10s));
+  StallingValue::stalls_released.store(true);
+  later_writes.wait();
+  stalled_writer.join();
+
+  for (auto i = 0; i < buffer_size; ++i) {
+    buffer.read_next([i](StallingValue const& a) { EXPECT_EQ(i, a.value); });
+  }
+}
@@ -7,68 +7,79 @@
 
 #include "ThreadSafeBuffer.hpp"
 
+auto constexpr buffer_size = 16;
+
+template <typename Buffer>
 class ThreadSafeBufferTest : public testing::Test {
  protected:
-  auto static constexpr buffer_size = 16;
   auto static constexpr n_passes = 1024;
   auto static constexpr n_values = n_passes * buffer_size;
 
   auto static constexpr n_threads = 16;
   auto static constexpr n_ops_per_thread = n_values / n_threads;
 
-  ThreadSafeBuffer<int, buffer_size> buffer{};
+  Buffer buffer{};
 };
 
-TEST_F(ThreadSafeBufferTest, SingleThreadAlternateWriteRead) {
+// Besides buffer_size, a small capacity that is not a power of 2, where all
+// threads contend for the same few slots, and a large one.
+using BufferTypes =
+    testing::Types<ThreadSafeBuffer<int, buffer_size>, ThreadSafeBuffer<int, 3>,
+                   ThreadSafeBuffer<int, 1000>>;
+TYPED_TEST_SUITE(ThreadSafeBufferTest, BufferTypes);
+
+TYPED_TEST(ThreadSafeBufferTest, SingleThreadAlternateWriteRead) {
   auto output_vector = std::vector<int>{};
 
-  for (auto i = 0; i < n_values; ++i) {
-    buffer.write_next(i);
-    buffer.read_next([&output_vector](int a) { output_vector.push_back(a); });
+  for (auto i = 0; i < this->n_values; ++i) {
+    this->buffer.write_next(i);
+    this->buffer.read_next(
+        [&output_vector](int a) { output_vector.push_back(a); });
   }
 
-  EXPECT_EQ(n_values, output_vector.size());
-  for (auto i = 0; i < n_values; ++i) {
+  EXPECT_EQ(this->n_values, output_vector.size());
+  for (auto i = 0; i < this->n_values; ++i) {
     EXPECT_EQ(i, output_vector[i]);
   }
 }
 
-TEST_F(ThreadSafeBufferTest, MultipleWritersSingleReader) {
+TYPED_TEST(ThreadSafeBufferTest, MultipleWritersSingleReader) {
   auto writers = std::vector<std::jthread>{};
   auto output_vector = std::vector<int>{};
 
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     writers.push_back(std::jthread(
         [this](int i) {
-          auto thread_offset = i * n_ops_per_thread;
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.write_next(thread_offset + j);
+          auto thread_offset = i * this->n_ops_per_thread;
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.write_next(thread_offset + j);
           }
         },
         i));
   }
-  for (auto i = 0; i < n_values; ++i) {
-    buffer.read_next([&output_vector](int a) { output_vector.push_back(a); });
+  for (auto i = 0; i < this->n_values; ++i) {
+    this->buffer.read_next(
+        [&output_vector](int a) { output_vector.push_back(a); });
   }
 
-  EXPECT_EQ(n_values, output_vector.size());
+  EXPECT_EQ(this->n_values, output_vector.size());
   std::sort(output_vector.begin(), output_vector.end());
   for (auto i = 0; auto const& x : output_vector) {
     EXPECT_EQ(i++, x);
   }
 }
 
-TEST_F(ThreadSafeBufferTest, SingleWriterMultipleReaders) {
+TYPED_TEST(ThreadSafeBufferTest, SingleWriterMultipleReaders) {
   auto readers = std::vector<std::jthread>{};
   auto output_vector = std::vector<int>{};
   auto output_mx = std::mutex{};
 
   // need to start readers before writing on main thread
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     readers.push_back(std::jthread(
         [this](auto read_func) {
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.read_next(read_func);
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.read_next(read_func);
           }
         },
         [&output_vector, &output_mx](int a) {
@@ -76,41 +87,41 @@ TEST_F(ThreadSafeBufferTest, SingleWriterMultipleReaders) {
           output_vector.push_back(a);
         }));
   }
-  for (auto i = 0; i < n_values; ++i) {
-    buffer.write_next(i);
+  for (auto i = 0; i < this->n_values; ++i) {
+    this->buffer.write_next(i);
   }
   for (auto& r : readers) {
     r.join();
   }
 
-  EXPECT_EQ(n_values, output_vector.size());
+  EXPECT_EQ(this->n_values, output_vector.size());
   std::sort(output_vector.begin(), output_vector.end());
   for (auto i = 0; auto const& x : output_vector) {
     EXPECT_EQ(i++, x);
   }
 }
 
-TEST_F(ThreadSafeBufferTest, MultipleWritersMultipleReadersWriteFirst) {
+TYPED_TEST(ThreadSafeBufferTest, MultipleWritersMultipleReadersWriteFirst) {
   auto writers = std::vector<std::jthread>{};
   auto readers = std::vector<std::jthread>{};
   auto output_vector = std::vector<int>{};
   auto output_mx = std::mutex{};
 
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     writers.push_back(std::jthread(
         [this](int i) {
-          auto thread_offset = i * n_ops_per_thread;
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.write_next(thread_offset + j);
+          auto thread_offset = i * this->n_ops_per_thread;
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.write_next(thread_offset + j);
           }
         },
         i));
   }
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     readers.push_back(std::jthread(
         [this](auto read_func) {
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.read_next(read_func);
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.read_next(read_func);
           }
         },
         [&output_vector, &output_mx](int a) {
@@ -122,24 +133,24 @@ TEST_F(ThreadSafeBufferTest, MultipleWritersMultipleReadersWriteFirst) {
     r.join();
   }
 
-  EXPECT_EQ(n_values, output_vector.size());
+  EXPECT_EQ(this->n_values, output_vector.size());
   std::sort(output_vector.begin(), output_vector.end());
   for (auto i = 0; auto const& x : output_vector) {
     EXPECT_EQ(i++, x);
   }
 }
 
-TEST_F(ThreadSafeBufferTest, MultipleWritersMultipleReadersReadFirst) {
+TYPED_TEST(ThreadSafeBufferTest, MultipleWritersMultipleReadersReadFirst) {
   auto writers = std::vector<std::jthread>{};
   auto readers = std::vector<std::jthread>{};
   auto output_vector = std::vector<int>{};
   auto output_mx = std::mutex{};
 
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     readers.push_back(std::jthread(
         [this](auto read_func) {
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.read_next(read_func);
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.read_next(read_func);
           }
         },
         [&output_vector, &output_mx](int a) {
@@ -147,12 +158,12 @@ TEST_F(ThreadSafeBufferTest, MultipleWritersMultipleReadersReadFirst) {
           output_vector.push_back(a);
         }));
   }
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     writers.push_back(std::jthread(
         [this](int i) {
-          auto thread_offset = i * n_ops_per_thread;
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.write_next(thread_offset + j);
+          auto thread_offset = i * this->n_ops_per_thread;
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.write_next(thread_offset + j);
           }
         },
         i));
@@ -161,36 +172,36 @@ TEST_F(ThreadSafeBufferTest, MultipleWritersMultipleReadersReadFirst) {
     r.join();
   }
 
-  EXPECT_EQ(n_values, output_vector.size());
+  EXPECT_EQ(this->n_values, output_vector.size());
   std::sort(output_vector.begin(), output_vector.end());
   for (auto i = 0; auto const& x : output_vector) {
     EXPECT_EQ(i++, x);
   }
 }
 
-TEST_F(ThreadSafeBufferTest, MultipleWritersMultipleReadersSlowWrites) {
+TYPED_TEST(ThreadSafeBufferTest, MultipleWritersMultipleReadersSlowWrites) {
   auto writers = std::vector<std::jthread>{};
   auto readers = std::vector<std::jthread>{};
   auto output_vector = std::vector<int>{};
   auto output_mx = std::mutex{};
 
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     writers.push_back(std::jthread(
         [this](int i) {
-          auto thread_offset = i * n_ops_per_thread;
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
+          auto thread_offset = i * this->n_ops_per_thread;
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
             using namespace std::chrono_literals;
             std::this_thread::sleep_for(1us);
-            buffer.write_next(thread_offset + j);
+            this->buffer.write_next(thread_offset + j);
           }
         },
         i));
   }
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     readers.push_back(std::jthread(
         [this](auto read_func) {
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.read_next(read_func);
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.read_next(read_func);
           }
         },
         [&output_vector, &output_mx](int a) {
@@ -202,34 +213,34 @@ TEST_F(ThreadSafeBufferTest, MultipleWritersMultipleReadersSlowWrites) {
     r.join();
   }
 
-  EXPECT_EQ(n_values, output_vector.size());
+  EXPECT_EQ(this->n_values, output_vector.size());
   std::sort(output_vector.begin(), output_vector.end());
   for (auto i = 0; auto const& x : output_vector) {
     EXPECT_EQ(i++, x);
   }
 }
 
-TEST_F(ThreadSafeBufferTest, MultipleWritersMultipleReadersSlowReads) {
+TYPED_TEST(ThreadSafeBufferTest, MultipleWritersMultipleReadersSlowReads) {
   auto writers = std::vector<std::jthread>{};
   auto readers = std::vector<std::jthread>{};
   auto output_vector = std::vector<int>{};
   auto output_mx = std::mutex{};
 
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     writers.push_back(std::jthread(
         [this](int i) {
-          auto thread_offset = i * n_ops_per_thread;
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.write_next(thread_offset + j);
+          auto thread_offset = i * this->n_ops_per_thread;
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.write_next(thread_offset + j);
           }
         },
         i));
   }
-  for (auto i = 0; i < n_threads; ++i) {
+  for (auto i = 0; i < this->n_threads; ++i) {
     readers.push_back(std::jthread(
         [this](auto read_func) {
-          for (auto j = 0; j < n_ops_per_thread; ++j) {
-            buffer.read_next(read_func);
+          for (auto j = 0; j < this->n_ops_per_thread; ++j) {
+            this->buffer.read_next(read_func);
           }
         },
         [&output_vector, &output_mx](int a) {
@@ -243,7 +254,7 @@ TEST_F(ThreadSafeBufferTest, MultipleWritersMultipleReadersSlowReads) {
     r.join();
   }
 
-  EXPECT_EQ(n_values, output_vector.size());
+  EXPECT_EQ(this->n_values, output_vector.size());
   std::sort(output_vector.begin(), output_vector.end());
   for (auto i = 0; auto const& x : output_vector) {
     EXPECT_EQ(i++, x);
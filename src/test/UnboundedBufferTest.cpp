@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "UnboundedBuffer.hpp"
+
+auto constexpr segment_size = 16;
+
+template <typename Buffer>
+class UnboundedBufferTest : public testing::Test {
+ protected:
+  auto static constexpr n_passes = 1024;
+  auto static constexpr n_values = n_passes * segment_size;
+
+  auto static constexpr n_threads = 16;
+  auto static constexpr n_ops_per_thread = n_values / n_threads;
+
+  Buffer buffer{};
+};
+
+using BufferTypes =
+    testing::Types<UnboundedBuffer<int, segment_size>,
+                   UnboundedBuffer<int, segment_size, SpinThenPark>,
+                   UnboundedBuffer<int, 1>>;
+TYPED_TEST_SUITE(UnboundedBufferTest, BufferTypes);
+
+TYPED_TEST(UnboundedBufferTest, SingleThreadAlternateWriteRead) {
+  auto output = std::vector<int>{};
+
+  for (auto i = 0; i < this->n_values; ++i) {
+    this->buffer.write_next(i);
+    this->buffer.read_next([&output](int a) { output.push_back(a); });
+  }
+
+  ASSERT_EQ(this->n_values, output.size());
+  for (auto i = 0; i < this->n_values; ++i) {
+    EXPECT_EQ(i, output[i]);
+  }
+}
+
+TYPED_TEST(UnboundedBufferTest, WritesNeverWaitForReaders) {
+  auto output = std::vector<int>{};
+
+  for (auto i = 0; i < this->n_values; ++i) {
+    this->buffer.write_next(i);
+  }
+  for (auto i = 0; i < this->n_values; ++i) {
+    this->buffer.read_next([&output](int a) { output.push_back(a); });
+  }
+
+  ASSERT_EQ(this->n_values, output.size());
+  for (auto i = 0; i < this->n_values; ++i) {
+    EXPECT_EQ(i, output[i]);
+  }
+}
+
+TYPED_TEST(UnboundedBufferTest, RecyclesSegments) {
+  auto constexpr burst = 4 * TypeParam::segment_size;
+  for (auto pass = 0; pass < this->n_passes; ++pass) {
+    for (auto i = 0; i < burst; ++i) {
+      this->buffer.write_next(i);
+    }
+    for (auto i = 0; i < burst; ++i) {
+      this->buffer.read_next([i](int a) { EXPECT_EQ(i, a); });
+    }
+  }
+
+  // The burst, plus the segment that is partly read when it starts.
+  EXPECT_LE(this->buffer.segment_count(), burst / TypeParam::segment_size + 1);
+}
+
+TYPED_TEST(UnboundedBufferTest, TryReadFailsWhenEmpty) {
+  auto output = -1;
+  EXPECT_FALSE(this->buffer.try_read_next([&output](int a) { output = a; }));
+
+  // Across segment boundaries too.
+  for (auto i = 0; i < 3 * segment_size; ++i) {
+    this->buffer.write_next(i);
+  }
+  for (auto i = 0; i < 3 * segment_size; ++i) {
+    EXPECT_TRUE(this->buffer.try_read_next([&output](int a) { output = a; }));
+    EXPECT_EQ(i, output);
+  }
+  EXPECT_FALSE(this->buffer.try_read_next([&output](int a) { output = a; }));
+}
+
+TYPED_TEST(UnboundedBufferTest, MultipleWritersMultipleReaders) {
+  auto output = std::vector<int>{};
+  auto output_mx = std::mutex{};
+
+  auto threads = std::vector<std::jthread>{};
+  for (auto t = 0; t < this->n_threads; ++t) {
+    threads.emplace_back([this, t]() {
+      for (auto i = 0; i < this->n_ops_per_thread; ++i) {
+        this->buffer.write_next(t * this->n_ops_per_thread + i);
+      }
+    });
+    threads.emplace_back([this, &output, &output_mx, t]() {
+      auto read = std::vector<int>{};
+      for (auto i = 0; i < this->n_ops_per_thread; ++i) {
+        auto read_func = [&read](int a) { read.push_back(a); };
+        // Mixes blocking and non-blocking reads on the same buffer.
+        if (t % 2 == 0) {
+          this->buffer.read_next(read_func);
+        } else {
+          while (not this->buffer.try_read_next(read_func)) {
+            std::this_thread::yield();
+          }
+        }
+      }
+      auto lock = std::scoped_lock{output_mx};
+      output.insert(output.end(), read.begin(), read.end());
+    });
+  }
+  threads.clear();
+
+  ASSERT_EQ(this->n_values, output.size());
+  std::ranges::sort(output);
+  for (auto i = 0; i < this->n_values; ++i) {
+    EXPECT_EQ(i, output[i]);
+  }
+}
+
+// Counts the values alive, to check that each is destroyed exactly once.
+struct CountedValue {
+  static inline auto alive = std::atomic<int>{};
+
+  std::unique_ptr<int> value;
+
+  explicit CountedValue(int v) : value{std::make_unique<int>(v)} { ++alive; }
+  CountedValue(CountedValue&& other) noexcept
+      : value{std::move(other.value)} {
+    ++alive;
+  }
+  ~CountedValue() { --alive; }
+};
+
+TEST(UnboundedBufferLifetimeTest, DestroysEveryValueOnce) {
+  {
+    auto buffer = UnboundedBuffer<CountedValue, segment_size>{};
+    for (auto i = 0; i < 5 * segment_size; ++i) {
+      buffer.write_next(CountedValue{i});
+    }
+    for (auto i = 0; i < 2 * segment_size + 3; ++i) {
+      buffer.read_next([i](CountedValue& v) { EXPECT_EQ(i, *v.value); });
+    }
+    EXPECT_EQ(3 * segment_size - 3, CountedValue::alive);
+  }
+  EXPECT_EQ(0, CountedValue::alive);
+}